@@ -28,6 +28,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Tutorial.hpp"
 #include "Utils/Folders.hpp"
 #include <physfs.h>
+#include <pthread.h>
 
 extern float multiplier;
 extern float gravity;
@@ -46,10 +47,14 @@ static void pfs_seek_cur(PHYSFS_File *handle, PHYSFS_uint64 offset){
     PHYSFS_seek(handle, curpos + offset);
 }
 
+SkeletonMeshes::SkeletonMeshes()
+    : num_models(0)
+{
+}
+
 Skeleton::Skeleton()
     : selected(0)
     , id(0)
-    , num_models(0)
     , clothes(false)
     , spinny(false)
     , skinsize(0)
@@ -137,8 +142,8 @@ float Skeleton::DoConstraints(XYZ* coords, float* scale)
     if (free) {
         freetime += multiplier;
 
-        whichpatchx = coords->x / (terrain.size / subdivision * terrain.scale);
-        whichpatchz = coords->z / (terrain.size / subdivision * terrain.scale);
+        whichpatchx = coords->x / (terrain.size / terrain.subdivision * terrain.scale);
+        whichpatchz = coords->z / (terrain.size / terrain.subdivision * terrain.scale);
 
         terrainlight = *coords;
         Object::SphereCheckPossible(&terrainlight, 1);
@@ -350,7 +355,7 @@ float Skeleton::DoConstraints(XYZ* coords, float* scale)
                     }
                 }
                 for (unsigned int m = 0; m < terrain.patchobjects[whichpatchx][whichpatchz].size(); m++) {
-                    unsigned int k = terrain.patchobjects[whichpatchx][whichpatchz][m];
+                    unsigned int k = terrain.patchObject(whichpatchx, whichpatchz, m);
                     if (k < Object::objects.size()) {
                         if (Object::objects[k]->possible) {
                             friction = Object::objects[k]->friction;
@@ -441,7 +446,7 @@ float Skeleton::DoConstraints(XYZ* coords, float* scale)
         multiplier = tempmult;
 
         for (unsigned int m = 0; m < terrain.patchobjects[whichpatchx][whichpatchz].size(); m++) {
-            unsigned int k = terrain.patchobjects[whichpatchx][whichpatchz][m];
+            unsigned int k = terrain.patchObject(whichpatchx, whichpatchz, m);
             if (Object::objects[k]->possible) {
                 for (i = 0; i < 26; i++) {
                     //Make this less stupid
@@ -671,9 +676,83 @@ struct SkeletonTransformLoadedModelJob: WorkerThread::Job {
     }
 };
 
+/**
+ * Bind-pose meshes shared between skeletons. Only the skeletons hold strong
+ * references, so a creature type's meshes go away with its last Person.
+ * */
+struct SkeletonMeshesEntry {
+    std::string key;
+    std::weak_ptr<const SkeletonMeshes> meshes;
+};
+
+static pthread_mutex_t mtxMeshes = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<SkeletonMeshesEntry> meshesStore;
+
+static std::shared_ptr<const SkeletonMeshes> findSkeletonMeshes(const std::string& key)
+{
+    std::shared_ptr<const SkeletonMeshes> ret = nullptr;
+
+    if(pthread_mutex_lock(&mtxMeshes)){
+        ASSERT(!"Failed to lock skeleton meshes mutex");
+        return nullptr;
+    }
+
+    for (unsigned i = 0; i < meshesStore.size();) {
+        if (meshesStore[i].meshes.expired()) {
+            meshesStore.erase(meshesStore.begin() + i);
+            continue;
+        }
+        if (meshesStore[i].key == key) {
+            ret = meshesStore[i].meshes.lock();
+            break;
+        }
+        i++;
+    }
+
+    if(pthread_mutex_unlock(&mtxMeshes)){
+        ASSERT(!"Failed to unlock skeleton meshes mutex");
+    }
+    return ret;
+}
+
+/* returns the meshes to use, which are someone else's if they finished first */
+static std::shared_ptr<const SkeletonMeshes> addSkeletonMeshes(const std::string& key, std::shared_ptr<const SkeletonMeshes> meshes)
+{
+    if(pthread_mutex_lock(&mtxMeshes)){
+        ASSERT(!"Failed to lock skeleton meshes mutex");
+        return meshes;
+    }
+
+    bool found = false;
+    for (unsigned i = 0; i < meshesStore.size(); i++) {
+        if (meshesStore[i].key == key) {
+            std::shared_ptr<const SkeletonMeshes> existing = meshesStore[i].meshes.lock();
+            if (existing != nullptr) {
+                meshes = existing;
+            } else {
+                meshesStore[i].meshes = meshes;
+            }
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        SkeletonMeshesEntry entry;
+        entry.key = key;
+        entry.meshes = meshes;
+        meshesStore.push_back(entry);
+    }
+
+    if(pthread_mutex_unlock(&mtxMeshes)){
+        ASSERT(!"Failed to unlock skeleton meshes mutex");
+    }
+    return meshes;
+}
+
 /* EFFECT
  * load skeleton
  * takes filenames for three skeleton files and various models
+ * bind-pose meshes are shared with other skeletons loaded from the same files
  */
 void Skeleton::Load(const std::string& filename, const std::string& lowfilename, const std::string& clothesfilename,
                     const std::string& modelfilename, const std::string& model2filename,
@@ -690,20 +769,28 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
 
     LOGFUNC;
 
-    num_models = 7; 
+    // every input to the bind pose, the model transforms are fixed
+    std::string meshesKey = filename + ";" + lowfilename + ";" + clothesfilename + ";" +
+                            modelfilename + ";" + model2filename + ";" + model3filename + ";" +
+                            model4filename + ";" + model5filename + ";" + model6filename + ";" +
+                            model7filename + ";" + modellowfilename + ";" + modelclothesfilename +
+                            (clothes ? ";clothes" : "");
+
+    meshes = findSkeletonMeshes(meshesKey);
+
+    // only build the bind-pose meshes if no other skeleton has them yet
+    std::shared_ptr<SkeletonMeshes> building = nullptr;
+    if (meshes == nullptr) {
+        building = std::make_shared<SkeletonMeshes>();
+        building->num_models = 7;
+    }
 
     // load various models
     // rotate, scale, do normals, do texcoords for each as needed
     WorkerThread::JobHandle loadJobs[] = {
-        model[0].submitLoadnotex(modelfilename),
-        model[1].submitLoadnotex(model2filename),
-        model[2].submitLoadnotex(model3filename),
-        model[3].submitLoadnotex(model4filename),
-        model[4].submitLoadnotex(model5filename),
-        model[5].submitLoadnotex(model6filename),
-        model[6].submitLoadnotex(model7filename),
+        -1, -1, -1, -1, -1, -1, -1,
         drawmodel.submitLoad(modelfilename),
-        modellow.submitLoadnotex(modellowfilename),
+        -1,
         drawmodellow.submitLoad(modellowfilename),
         -1,
         -1
@@ -711,21 +798,32 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
     const int numJobs = sizeof(loadJobs) / sizeof(WorkerThread::JobHandle);
     WorkerThread::JobHandle transform_jobs[numJobs];
 
-
-    for (int i = 0; i < num_models; i++) {
-        transform_jobs[i] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[i], &model[i], false, false);
+    if (building != nullptr) {
+        const std::string* modelfilenames[] = {
+            &modelfilename, &model2filename, &model3filename, &model4filename,
+            &model5filename, &model6filename, &model7filename
+        };
+        for (int i = 0; i < building->num_models; i++) {
+            loadJobs[i] = building->model[i].submitLoadnotex(*modelfilenames[i]);
+            transform_jobs[i] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[i], &building->model[i], false, false);
+        }
+        loadJobs[8] = building->modellow.submitLoadnotex(modellowfilename);
+        transform_jobs[8] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[8], &building->modellow, false, false);
     }
     transform_jobs[7] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[7], &drawmodel, true, false);
-    transform_jobs[8] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[8], &modellow, false, false);
     transform_jobs[9] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[9], &drawmodellow, true, false);
 
     if (clothes) {
-        loadJobs[10] = modelclothes.submitLoadnotex(modelclothesfilename);
-        transform_jobs[10] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[10], &modelclothes, false, true);
+        if (building != nullptr) {
+            loadJobs[10] = building->modelclothes.submitLoadnotex(modelclothesfilename);
+            transform_jobs[10] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[10], &building->modelclothes, false, true);
+        }
         loadJobs[11] = drawmodelclothes.submitLoad(modelclothesfilename);
         transform_jobs[11] = WorkerThread::submitDependentJob<SkeletonTransformLoadedModelJob>(loadJobs[11], &drawmodelclothes, true, false);
     }
 
+    const SkeletonMeshes& bind = building != nullptr ? *building : *meshes;
+
     for(int i = 0; i < numJobs; i++){
         if(loadJobs[i] == -1) continue;
         WorkerThread::join(loadJobs[i], true);
@@ -823,7 +921,7 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
 
     // for each muscle...
     for (int i = 0; i < num_muscles; i++) {
-        muscles[i].load(tfile, model[0].vertexNum, joints);
+        muscles[i].load(tfile, bind.model[0].vertexNum, joints);
     }
 
     // read forwardjoints (?)
@@ -835,40 +933,49 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
         funpackf(tfile, "Bi", &lowforwardjoints[j]);
     }
 
-    // ???
-    for (j = 0; j < num_muscles; j++) {
-        for (unsigned i = 0; i < muscles[j].vertices.size(); i++) {
-            for (int k = 0; k < num_models; k++) {
-                if (muscles[j].vertices[i] < model[k].vertexNum) {
-                    model[k].owner[muscles[j].vertices[i]] = j;
-                }
-            }
-        }
-    }
-
     // calculate some stuff
     FindForwards();
     for (int i = 0; i < num_muscles; i++) {
         FindRotationMuscle(i, -1);
     }
-    // this seems to use opengl purely for matrix calculations
-    for (int k = 0; k < num_models; k++) {
-        for (int i = 0; i < model[k].vertexNum; i++) {
-            model[k].vertex[i] = model[k].vertex[i] - (muscles[model[k].owner[i]].parent1->position + muscles[model[k].owner[i]].parent2->position) / 2;
-            glMatrixMode(GL_MODELVIEW);
-            glPushMatrix();
-            glLoadIdentity();
-            glRotatef(muscles[model[k].owner[i]].rotate3, 0, 1, 0);
-            glRotatef(muscles[model[k].owner[i]].rotate2 - 90, 0, 0, 1);
-            glRotatef(muscles[model[k].owner[i]].rotate1 - 90, 0, 1, 0);
-            glTranslatef(model[k].vertex[i].x, model[k].vertex[i].y, model[k].vertex[i].z);
-            glGetFloatv(GL_MODELVIEW_MATRIX, M);
-            model[k].vertex[i].x = M[12] * 1;
-            model[k].vertex[i].y = M[13] * 1;
-            model[k].vertex[i].z = M[14] * 1;
-            glPopMatrix();
+
+    if (building != nullptr) {
+        Model* model = building->model;
+        const int num_models = building->num_models;
+
+        // ???
+        for (j = 0; j < num_muscles; j++) {
+            for (unsigned i = 0; i < muscles[j].vertices.size(); i++) {
+                for (int k = 0; k < num_models; k++) {
+                    if (muscles[j].vertices[i] < model[k].vertexNum) {
+                        model[k].owner[muscles[j].vertices[i]] = j;
+                    }
+                }
+            }
         }
-        model[k].CalculateNormals(0);
+
+        // this seems to use opengl purely for matrix calculations
+        for (int k = 0; k < num_models; k++) {
+            for (int i = 0; i < model[k].vertexNum; i++) {
+                model[k].vertex[i] = model[k].vertex[i] - (muscles[model[k].owner[i]].parent1->position + muscles[model[k].owner[i]].parent2->position) / 2;
+                glMatrixMode(GL_MODELVIEW);
+                glPushMatrix();
+                glLoadIdentity();
+                glRotatef(muscles[model[k].owner[i]].rotate3, 0, 1, 0);
+                glRotatef(muscles[model[k].owner[i]].rotate2 - 90, 0, 0, 1);
+                glRotatef(muscles[model[k].owner[i]].rotate1 - 90, 0, 1, 0);
+                glTranslatef(model[k].vertex[i].x, model[k].vertex[i].y, model[k].vertex[i].z);
+                glGetFloatv(GL_MODELVIEW_MATRIX, M);
+                model[k].vertex[i].x = M[12] * 1;
+                model[k].vertex[i].y = M[13] * 1;
+                model[k].vertex[i].z = M[14] * 1;
+                glPopMatrix();
+            }
+            model[k].invalidateBVH();
+            model[k].CalculateNormals(0);
+        }
+
+        building->skin.build(muscles, &Muscle::vertices, model, num_models);
     }
     PHYSFS_close(tfile);
 
@@ -903,7 +1010,7 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
         //fseek(tfile, lSize, SEEK_CUR);
         pfs_seek_cur(tfile, lSize);
 
-        muscles[i].loadVerticesLow(tfile, modellow.vertexNum);
+        muscles[i].loadVerticesLow(tfile, bind.modellow.vertexNum);
 
         // skip more stuff
         lSize = 1; //sizeof(bool);
@@ -916,32 +1023,39 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
         pfs_seek_cur(tfile, lSize);
     }
 
-    for (j = 0; j < num_muscles; j++) {
-        for (unsigned i = 0; i < muscles[j].verticeslow.size(); i++) {
-            if (muscles[j].verticeslow[i] < modellow.vertexNum) {
-                modellow.owner[muscles[j].verticeslow[i]] = j;
+    if (building != nullptr) {
+        Model& modellow = building->modellow;
+
+        for (j = 0; j < num_muscles; j++) {
+            for (unsigned i = 0; i < muscles[j].verticeslow.size(); i++) {
+                if (muscles[j].verticeslow[i] < modellow.vertexNum) {
+                    modellow.owner[muscles[j].verticeslow[i]] = j;
+                }
             }
         }
-    }
 
-    // use opengl for its matrix math
-    for (int i = 0; i < modellow.vertexNum; i++) {
-        modellow.vertex[i] = modellow.vertex[i] - (muscles[modellow.owner[i]].parent1->position + muscles[modellow.owner[i]].parent2->position) / 2;
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
-        glRotatef(muscles[modellow.owner[i]].rotate3, 0, 1, 0);
-        glRotatef(muscles[modellow.owner[i]].rotate2 - 90, 0, 0, 1);
-        glRotatef(muscles[modellow.owner[i]].rotate1 - 90, 0, 1, 0);
-        glTranslatef(modellow.vertex[i].x, modellow.vertex[i].y, modellow.vertex[i].z);
-        glGetFloatv(GL_MODELVIEW_MATRIX, M);
-        modellow.vertex[i].x = M[12];
-        modellow.vertex[i].y = M[13];
-        modellow.vertex[i].z = M[14];
-        glPopMatrix();
-    }
+        // use opengl for its matrix math
+        for (int i = 0; i < modellow.vertexNum; i++) {
+            modellow.vertex[i] = modellow.vertex[i] - (muscles[modellow.owner[i]].parent1->position + muscles[modellow.owner[i]].parent2->position) / 2;
+            glMatrixMode(GL_MODELVIEW);
+            glPushMatrix();
+            glLoadIdentity();
+            glRotatef(muscles[modellow.owner[i]].rotate3, 0, 1, 0);
+            glRotatef(muscles[modellow.owner[i]].rotate2 - 90, 0, 0, 1);
+            glRotatef(muscles[modellow.owner[i]].rotate1 - 90, 0, 1, 0);
+            glTranslatef(modellow.vertex[i].x, modellow.vertex[i].y, modellow.vertex[i].z);
+            glGetFloatv(GL_MODELVIEW_MATRIX, M);
+            modellow.vertex[i].x = M[12];
+            modellow.vertex[i].y = M[13];
+            modellow.vertex[i].z = M[14];
+            glPopMatrix();
+        }
 
-    modellow.CalculateNormals(0);
+        modellow.invalidateBVH();
+        modellow.CalculateNormals(0);
+
+        building->skinlow.build(muscles, &Muscle::verticeslow, &modellow, 1);
+    }
 
     // load clothes
 
@@ -975,7 +1089,7 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
             //fseek(tfile, lSize, SEEK_CUR);
             pfs_seek_cur(tfile, lSize);
 
-            muscles[i].loadVerticesClothes(tfile, modelclothes.vertexNum);
+            muscles[i].loadVerticesClothes(tfile, bind.modelclothes.vertexNum);
 
             // skip more stuff
             lSize = 1; //sizeof(bool);
@@ -990,35 +1104,46 @@ void Skeleton::Load(const std::string& filename, const std::string& lowfilename,
 
         // ???
         lSize = sizeof(int);
-        for (j = 0; j < num_muscles; j++) {
-            for (unsigned i = 0; i < muscles[j].verticesclothes.size(); i++) {
-                if (muscles[j].verticesclothes.size() && muscles[j].verticesclothes[i] < modelclothes.vertexNum) {
-                    modelclothes.owner[muscles[j].verticesclothes[i]] = j;
+        if (building != nullptr) {
+            Model& modelclothes = building->modelclothes;
+
+            for (j = 0; j < num_muscles; j++) {
+                for (unsigned i = 0; i < muscles[j].verticesclothes.size(); i++) {
+                    if (muscles[j].verticesclothes.size() && muscles[j].verticesclothes[i] < modelclothes.vertexNum) {
+                        modelclothes.owner[muscles[j].verticesclothes[i]] = j;
+                    }
                 }
             }
-        }
 
-        // use opengl for its matrix math
-        for (int i = 0; i < modelclothes.vertexNum; i++) {
-            modelclothes.vertex[i] = modelclothes.vertex[i] - (muscles[modelclothes.owner[i]].parent1->position + muscles[modelclothes.owner[i]].parent2->position) / 2;
-            glMatrixMode(GL_MODELVIEW);
-            glPushMatrix();
-            glLoadIdentity();
-            glRotatef(muscles[modelclothes.owner[i]].rotate3, 0, 1, 0);
-            glRotatef(muscles[modelclothes.owner[i]].rotate2 - 90, 0, 0, 1);
-            glRotatef(muscles[modelclothes.owner[i]].rotate1 - 90, 0, 1, 0);
-            glTranslatef(modelclothes.vertex[i].x, modelclothes.vertex[i].y, modelclothes.vertex[i].z);
-            glGetFloatv(GL_MODELVIEW_MATRIX, M);
-            modelclothes.vertex[i].x = M[12];
-            modelclothes.vertex[i].y = M[13];
-            modelclothes.vertex[i].z = M[14];
-            glPopMatrix();
-        }
+            // use opengl for its matrix math
+            for (int i = 0; i < modelclothes.vertexNum; i++) {
+                modelclothes.vertex[i] = modelclothes.vertex[i] - (muscles[modelclothes.owner[i]].parent1->position + muscles[modelclothes.owner[i]].parent2->position) / 2;
+                glMatrixMode(GL_MODELVIEW);
+                glPushMatrix();
+                glLoadIdentity();
+                glRotatef(muscles[modelclothes.owner[i]].rotate3, 0, 1, 0);
+                glRotatef(muscles[modelclothes.owner[i]].rotate2 - 90, 0, 0, 1);
+                glRotatef(muscles[modelclothes.owner[i]].rotate1 - 90, 0, 1, 0);
+                glTranslatef(modelclothes.vertex[i].x, modelclothes.vertex[i].y, modelclothes.vertex[i].z);
+                glGetFloatv(GL_MODELVIEW_MATRIX, M);
+                modelclothes.vertex[i].x = M[12];
+                modelclothes.vertex[i].y = M[13];
+                modelclothes.vertex[i].z = M[14];
+                glPopMatrix();
+            }
 
-        modelclothes.CalculateNormals(0);
+            modelclothes.invalidateBVH();
+            modelclothes.CalculateNormals(0);
+
+            building->skinclothes.build(muscles, &Muscle::verticesclothes, &modelclothes, 1);
+        }
     }
     PHYSFS_close(tfile);
 
+    if (building != nullptr) {
+        meshes = addSkeletonMeshes(meshesKey, building);
+    }
+
     for (int i = 0; i < num_joints; i++) {
         for (j = 0; j < num_joints; j++) {
             if (joints[i].label == j) {
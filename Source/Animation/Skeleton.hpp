@@ -24,6 +24,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Animation/Animation.hpp"
 #include "Animation/Joint.hpp"
 #include "Animation/Muscle.hpp"
+#include "Animation/Skinning.hpp"
 #include "Graphic/Models.hpp"
 #include "Graphic/Sprite.hpp"
 #include "Graphic/gamegl.hpp"
@@ -31,10 +32,32 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Objects/Object.hpp"
 #include "Utils/binio.h"
 
+#include <memory>
+
 #define SKINTEX_SQSIZE 256
 
 const int max_joints = 50;
 
+/**
+ * Bind-pose meshes of a creature type. Built once by the first Skeleton::Load
+ * that needs them and only read afterwards, so every skeleton of the same
+ * type shares one copy. Skinned output lives in each Skeleton's drawmodel*.
+ * */
+class SkeletonMeshes
+{
+public:
+    Model model[7];
+    Model modellow;
+    Model modelclothes;
+    int num_models;
+
+    SkinStream skin;
+    SkinStream skinlow;
+    SkinStream skinclothes;
+
+    SkeletonMeshes();
+};
+
 class Skeleton
 {
 public:
@@ -55,10 +78,7 @@ public:
     XYZ specialforward[5];
     int jointlabels[max_joints];
 
-    Model model[7];
-    Model modellow;
-    Model modelclothes;
-    int num_models;
+    std::shared_ptr<const SkeletonMeshes> meshes;
 
     Model drawmodel;
     Model drawmodellow;
@@ -0,0 +1,174 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Animation/Skinning.hpp"
+
+#include "Graphic/Models.hpp"
+#include "Math/Simd.hpp"
+#include "Utils/Log.h"
+
+void SkinTransform::set(const matrix4x4 mat, const XYZ& proportion, float scale)
+{
+    const float prop[3] = { proportion.x, proportion.y, proportion.z };
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            m[r][c] = mat[r][c] * prop[c] * scale;
+        }
+        m[r][3] = mat[r][3] * scale;
+    }
+}
+
+SkinStream::SkinStream()
+    : stride(0)
+{
+}
+
+void SkinStream::clear()
+{
+    muscleFirst.clear();
+    muscleCount.clear();
+    index.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    stride = 0;
+}
+
+void SkinStream::build(const std::vector<Muscle>& muscles, std::vector<int> Muscle::*vertices, const Model* targets, int numTargets)
+{
+    clear();
+
+    muscleFirst.resize(muscles.size());
+    muscleCount.resize(muscles.size());
+    for (unsigned i = 0; i < muscles.size(); i++) {
+        const std::vector<int>& verts = muscles[i].*vertices;
+        muscleFirst[i] = index.size();
+        muscleCount[i] = verts.size();
+        index.insert(index.end(), verts.begin(), verts.end());
+    }
+
+    stride = index.size();
+    x.resize(stride * numTargets);
+    y.resize(stride * numTargets);
+    z.resize(stride * numTargets);
+
+    for (int t = 0; t < numTargets; t++) {
+        for (unsigned i = 0; i < stride; i++) {
+            ASSERT(index[i] < targets[t].vertexNum);
+            const XYZ& v = targets[t].vertex[index[i]];
+            x[t * stride + i] = v.x;
+            y[t * stride + i] = v.y;
+            z[t * stride + i] = v.z;
+        }
+    }
+}
+
+unsigned SkinStream::count(unsigned muscle) const
+{
+    return muscle < muscleCount.size() ? muscleCount[muscle] : 0;
+}
+
+/* out[index[i]] = xf * lerp(a[i], b[i], morph), b may be null */
+static void skinKernel(const SkinTransform& xf,
+                       const float* ax, const float* ay, const float* az,
+                       const float* bx, const float* by, const float* bz, float morph,
+                       const int* index, unsigned n, XYZ* out)
+{
+    unsigned i = 0;
+
+#if VEC4_SIMD
+    const vec4 m00 = VEC4_SPLAT(xf.m[0][0]), m01 = VEC4_SPLAT(xf.m[0][1]), m02 = VEC4_SPLAT(xf.m[0][2]), m03 = VEC4_SPLAT(xf.m[0][3]);
+    const vec4 m10 = VEC4_SPLAT(xf.m[1][0]), m11 = VEC4_SPLAT(xf.m[1][1]), m12 = VEC4_SPLAT(xf.m[1][2]), m13 = VEC4_SPLAT(xf.m[1][3]);
+    const vec4 m20 = VEC4_SPLAT(xf.m[2][0]), m21 = VEC4_SPLAT(xf.m[2][1]), m22 = VEC4_SPLAT(xf.m[2][2]), m23 = VEC4_SPLAT(xf.m[2][3]);
+    const vec4 wa = VEC4_SPLAT(1 - morph);
+    const vec4 wb = VEC4_SPLAT(morph);
+
+    float res[3][4];
+    for (; i + 4 <= n; i += 4) {
+        vec4 vx = VEC4_LOAD(ax + i);
+        vec4 vy = VEC4_LOAD(ay + i);
+        vec4 vz = VEC4_LOAD(az + i);
+        if (bx) {
+            vx = VEC4_MADD(VEC4_MUL(vx, wa), VEC4_LOAD(bx + i), wb);
+            vy = VEC4_MADD(VEC4_MUL(vy, wa), VEC4_LOAD(by + i), wb);
+            vz = VEC4_MADD(VEC4_MUL(vz, wa), VEC4_LOAD(bz + i), wb);
+        }
+
+        VEC4_STORE(res[0], VEC4_MADD(VEC4_MADD(VEC4_MADD(m03, m00, vx), m01, vy), m02, vz));
+        VEC4_STORE(res[1], VEC4_MADD(VEC4_MADD(VEC4_MADD(m13, m10, vx), m11, vy), m12, vz));
+        VEC4_STORE(res[2], VEC4_MADD(VEC4_MADD(VEC4_MADD(m23, m20, vx), m21, vy), m22, vz));
+
+        for (int l = 0; l < 4; l++) {
+            XYZ& o = out[index[i + l]];
+            o.x = res[0][l];
+            o.y = res[1][l];
+            o.z = res[2][l];
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        float vx = ax[i];
+        float vy = ay[i];
+        float vz = az[i];
+        if (bx) {
+            vx = vx * (1 - morph) + bx[i] * morph;
+            vy = vy * (1 - morph) + by[i] * morph;
+            vz = vz * (1 - morph) + bz[i] * morph;
+        }
+
+        XYZ& o = out[index[i]];
+        o.x = xf.m[0][3] + xf.m[0][0] * vx + xf.m[0][1] * vy + xf.m[0][2] * vz;
+        o.y = xf.m[1][3] + xf.m[1][0] * vx + xf.m[1][1] * vy + xf.m[1][2] * vz;
+        o.z = xf.m[2][3] + xf.m[2][0] * vx + xf.m[2][1] * vy + xf.m[2][2] * vz;
+    }
+}
+
+void SkinStream::skin(unsigned muscle, const SkinTransform& xf, int target0, int target1, float morph, XYZ* out) const
+{
+    const unsigned n = count(muscle);
+    if (n == 0) {
+        return;
+    }
+    const unsigned first = muscleFirst[muscle];
+    const unsigned a = target0 * stride + first;
+    const unsigned b = target1 * stride + first;
+    ASSERT(a + n <= x.size() && b + n <= x.size());
+
+    skinKernel(xf,
+               &x[0] + a, &y[0] + a, &z[0] + a,
+               &x[0] + b, &y[0] + b, &z[0] + b, morph,
+               &index[0] + first, n, out);
+}
+
+void SkinStream::skin(unsigned muscle, const SkinTransform& xf, XYZ* out) const
+{
+    const unsigned n = count(muscle);
+    if (n == 0) {
+        return;
+    }
+    const unsigned first = muscleFirst[muscle];
+    ASSERT(first + n <= x.size());
+
+    skinKernel(xf,
+               &x[0] + first, &y[0] + first, &z[0] + first,
+               nullptr, nullptr, nullptr, 0,
+               &index[0] + first, n, out);
+}
@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SKINNING_HPP_
+#define _SKINNING_HPP_
+
+#include "Animation/Muscle.hpp"
+#include "Math/XYZ.hpp"
+
+#include <vector>
+
+class Model;
+
+/**
+ * Affine transform applied to every vertex of one muscle:
+ * out = m * (x, y, z, 1)
+ * */
+struct SkinTransform
+{
+    float m[3][4];
+
+    /* muscle matrix with the per-axis body proportions and the person's
+     * scale folded in, same result as translating a copy of `mat` by the
+     * scaled vertex and reading back its translation */
+    void set(const matrix4x4 mat, const XYZ& proportion, float scale);
+};
+
+/**
+ * Bind-pose vertices regrouped so each muscle's vertices are contiguous,
+ * stored as separate x/y/z arrays (one block per morph target) for the
+ * batched skinning kernel. Built once per mesh set in Skeleton::Load.
+ * */
+class SkinStream
+{
+public:
+    SkinStream();
+
+    void build(const std::vector<Muscle>& muscles, std::vector<int> Muscle::*vertices, const Model* targets, int numTargets);
+    void clear();
+
+    unsigned count(unsigned muscle) const;
+
+    /* skins a muscle's vertices into out[], lerping between two targets */
+    void skin(unsigned muscle, const SkinTransform& xf, int target0, int target1, float morph, XYZ* out) const;
+    void skin(unsigned muscle, const SkinTransform& xf, XYZ* out) const;
+
+private:
+    std::vector<unsigned> muscleFirst;
+    std::vector<unsigned> muscleCount;
+    std::vector<int> index; // destination vertex for each slot
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    unsigned stride;
+};
+
+#endif
@@ -21,6 +21,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "Audio/openal_wrapper.hpp"
 #include "Utils/Folders.hpp"
+#include "Utils/WorkerThread.hpp"
 
 struct OPENAL_SAMPLE* samp[sounds_count];
 
@@ -41,6 +42,8 @@ static const char* sound_data[sounds_count] = {
 
 #if AUDIO_DISABLED
 void loadAllSounds(){}
+void updateSoundLoading(){}
+void finishSoundLoading(){}
 void addEnvSound(XYZ coords, float vol, float life){}
 void emit_sound_at(int soundid, const XYZ& pos, float vol){}
 void emit_sound_np(int soundid, float vol){}
@@ -66,14 +69,48 @@ static int snd_mode(int snd)
     }
 }
 
+static WorkerThread::JobHandle soundJobs[sounds_count];
+static OPENAL_PCM* decodedSounds[sounds_count];
+
+struct DecodeSoundJob : WorkerThread::Job {
+    int id;
+    std::string path;
+    DecodeSoundJob(int _id, std::string _path)
+        : Job()
+        , id(_id)
+        , path(_path)
+    {
+        //--
+    }
+    ~DecodeSoundJob() = default;
+    void execute() override {
+        decodedSounds[id] = OPENAL_Sample_Decode(path.c_str());
+    }
+};
+
+/* uploads a decoded effect on the AL thread, its job must have been joined */
+static void uploadSound(int id)
+{
+    samp[id] = OPENAL_Sample_Upload(decodedSounds[id], snd_mode(id));
+    decodedSounds[id] = NULL;
+    soundJobs[id] = -1;
+}
+
 void loadAllSounds()
 {
     for (int i = 0; i < sounds_count; i++) {
-        std::string buf = std::string("Sounds/") + sound_data[i];
-        samp[i] = OPENAL_Sample_Load(OPENAL_FREE,
-                                     Folders::getResourcePath(buf).c_str(),
-                                     snd_mode(i),
-                                     0, 0);
+        std::string buf = Folders::getResourcePath(std::string("Sounds/") + sound_data[i]);
+        samp[i] = NULL;
+        soundJobs[i] = -1;
+        decodedSounds[i] = NULL;
+        if (!OPENAL_IsInitialized()) {
+            // nothing to load, plays are no-ops anyway
+        } else if (i >= stream_firesound && i <= stream_menutheme) {
+            // music and ambience are decoded while they play
+            samp[i] = OPENAL_Stream_Open(buf.c_str(), snd_mode(i));
+        } else {
+            soundJobs[i] = WorkerThread::submitJob<DecodeSoundJob>(i, buf);
+        }
     }
     footstepsound = footstepsn1;
     footstepsound2 = footstepsn2;
@@ -86,6 +123,35 @@ void loadAllSounds()
     }
 }
 
+void updateSoundLoading()
+{
+    for (int i = 0; i < sounds_count; i++) {
+        if (soundJobs[i] >= 0 && WorkerThread::tryJoin(soundJobs[i])) {
+            uploadSound(i);
+        }
+    }
+}
+
+void finishSoundLoading()
+{
+    for (int i = 0; i < sounds_count; i++) {
+        if (soundJobs[i] >= 0) {
+            WorkerThread::join(soundJobs[i], true);
+            uploadSound(i);
+        }
+    }
+}
+
+/* a sound wanted before its upload came around is finished right away,
+ * which costs at most that one decode */
+static void requireSound(int soundid)
+{
+    if (soundJobs[soundid] >= 0) {
+        WorkerThread::join(soundJobs[soundid], true);
+        uploadSound(soundid);
+    }
+}
+
 void addEnvSound(XYZ coords, float vol, float life)
 {
     envsound[numenvsounds] = coords;
@@ -96,6 +162,7 @@ void addEnvSound(XYZ coords, float vol, float life)
 
 void emit_sound_at(int soundid, const XYZ& pos, float vol)
 {
+    requireSound(soundid);
     PlaySoundEx(soundid, samp[soundid], NULL, true);
     OPENAL_3D_SetAttributes_(channels[soundid], pos);
     OPENAL_SetVolume(channels[soundid], vol);
@@ -104,6 +171,7 @@ void emit_sound_at(int soundid, const XYZ& pos, float vol)
 
 void emit_sound_np(int soundid, float vol)
 {
+    requireSound(soundid);
     PlaySoundEx(soundid, samp[soundid], NULL, true);
     OPENAL_SetVolume(channels[soundid], vol);
     OPENAL_SetPaused(channels[soundid], false);
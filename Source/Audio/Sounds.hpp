@@ -33,7 +33,11 @@ enum sound_type
 extern struct OPENAL_SAMPLE* samp[sounds_count];
 extern int channels[];
 
+/* effects decode on the worker threads, updateSoundLoading uploads the
+ * finished ones and must be called from the thread owning the AL context */
 extern void loadAllSounds();
+extern void updateSoundLoading();
+extern void finishSoundLoading();
 
 extern void addEnvSound(XYZ coords, float vol = 16, float life = .4);
 
@@ -118,15 +118,40 @@ typedef struct
     ALuint sid;
     OPENAL_SAMPLE* sample;
     bool startpaused;
+    bool streaming; // stream buffers should be refilled by OPENAL_Update
     float position[3];
 } OPENAL_Channels;
 
+// ~1.5s of 44.1kHz stereo, enough to ride out a long frame or a level load
+#define STREAM_BUFFER_COUNT 4
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+/* decoder state for samples opened with OPENAL_Stream_Open */
+struct OPENAL_STREAM_STATE
+{
+    OggVorbis_File vf;
+    ALuint buffers[STREAM_BUFFER_COUNT];
+    ALenum format;
+    ALuint freq;
+    bool eof;
+};
+
+typedef struct OPENAL_PCM
+{
+    char* name;
+    void* data;
+    ALenum format;
+    ALsizei size;
+    ALuint freq;
+} OPENAL_PCM;
+
 typedef struct OPENAL_SAMPLE
 {
     char* name;
-    ALuint bid; // buffer id.
+    ALuint bid; // buffer id, 0 for streams
     int mode;
     int is2d;
+    OPENAL_STREAM_STATE* stream; // NULL for fully decoded samples
 } OPENAL_SAMPLE;
 
 static size_t num_channels = 0;
@@ -289,6 +314,177 @@ AL_API void OPENAL_Close()
     initialized = false;
 }
 
+#ifdef __POWERPC__
+static const int bigendian = 1;
+#else
+static const int bigendian = 0;
+#endif
+
+static bool ogg_open(const char* _fname, OggVorbis_File& vf)
+{
+    // !!! FIXME: if it's not Ogg, we don't have a decoder. I'm lazy.  :/
+    char* fname = (char*)alloca(strlen(_fname) + 16);
+    strcpy(fname, _fname);
+    char* ptr = strchr(fname, '.');
+    if (ptr) {
+        *ptr = '\0';
+    }
+    strcat(fname, ".ogg");
+
+    /*
+    // just in case...
+    FILE* io = fopen(fname, "rb");
+    if (io == NULL) {
+        return NULL;
+    }
+    */
+
+    ov_callbacks pfs_callbacks;
+    pfs_callbacks.read_func = pfs_read;
+    pfs_callbacks.seek_func = pfs_seek;
+    pfs_callbacks.close_func = pfs_close;
+    pfs_callbacks.tell_func = pfs_tell;
+
+    pfs_handle *pfs_file = new pfs_handle();
+    if(!pfs_file->open(fname)){
+        delete pfs_file;
+        return false;
+    }
+
+    memset(&vf, '\0', sizeof(vf));
+    //if (ov_open(io, &vf, NULL, 0) == 0) {
+    if (ov_open_callbacks(pfs_file, &vf, NULL, 0, pfs_callbacks) == 0) {
+        return true; // vf owns pfs_file now, ov_clear closes it
+    }
+
+    //fclose(io);
+    pfs_file->close();
+    delete pfs_file;
+    return false;
+}
+
+static void* decode_to_pcm(const char* fname, ALenum& format, ALsizei& size, ALuint& freq)
+{
+    ALubyte* retval = NULL;
+
+    // Uncompress and feed to the AL.
+    OggVorbis_File vf;
+    if (ogg_open(fname, vf)) {
+        int bitstream = 0;
+        vorbis_info* info = ov_info(&vf, -1);
+        size = 0;
+        format = (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+        freq = info->rate;
+
+        if ((info->channels != 1) && (info->channels != 2)) {
+            ov_clear(&vf);
+            return NULL;
+        }
+
+        char buf[1024 * 16];
+        long rc = 0;
+        size_t allocated = 64 * 1024;
+        retval = (ALubyte*)malloc(allocated);
+        if(retval == NULL){
+            LOG("Failed to allocate %d bytes while decoding sound %s", allocated, fname);
+        }
+        while ((rc = ov_read(&vf, buf, sizeof(buf), bigendian, 2, 1, &bitstream)) != 0) {
+            if (rc > 0) {
+                size += rc;
+                if (size >= (int)allocated) {
+                    allocated *= 2;
+                    ALubyte* tmp = (ALubyte*)realloc(retval, allocated);
+                    if (tmp == NULL) {
+                        free(retval);
+                        retval = NULL;
+                        break;
+                    }
+                    retval = tmp;
+                }
+                memcpy(retval + (size - rc), buf, rc);
+            }
+        }
+        ov_clear(&vf);
+        return retval;
+    }
+
+    return NULL;
+}
+
+/* decodes the next STREAM_BUFFER_SIZE bytes into bid, rewinding at the end of
+ * looping streams. Returns false once a non-looping stream ran out. */
+static bool stream_fill(OPENAL_SAMPLE* sptr, ALuint bid)
+{
+    OPENAL_STREAM_STATE* stream = sptr->stream;
+    if (stream->eof) {
+        return false;
+    }
+
+    static char buf[STREAM_BUFFER_SIZE];
+    int size = 0;
+    int bitstream = 0;
+    bool rewound = false;
+    while (size < STREAM_BUFFER_SIZE) {
+        long rc = ov_read(&stream->vf, buf + size, STREAM_BUFFER_SIZE - size, bigendian, 2, 1, &bitstream);
+        if (rc > 0) {
+            size += rc;
+            rewound = false;
+        } else if (rc == 0 && sptr->mode == OPENAL_LOOP_NORMAL && !rewound) {
+            // guard against empty files spinning here forever
+            ov_pcm_seek(&stream->vf, 0);
+            rewound = true;
+        } else if (rc == OV_HOLE) {
+            continue;
+        } else {
+            stream->eof = true;
+            break;
+        }
+    }
+
+    if (size == 0) {
+        return false;
+    }
+    alBufferData(bid, stream->format, buf, size, stream->freq);
+    return true;
+}
+
+static void stream_rewind(OPENAL_SAMPLE* sptr)
+{
+    ov_pcm_seek(&sptr->stream->vf, 0);
+    sptr->stream->eof = false;
+}
+
+/* swaps finished buffers of every playing stream for freshly decoded ones */
+static void stream_update()
+{
+    for (unsigned i = 0; i < num_channels; i++) {
+        OPENAL_Channels* chan = &impl_channels[i];
+        if (!chan->streaming || !chan->sample || !chan->sample->stream) {
+            continue;
+        }
+
+        ALint processed = 0;
+        alGetSourcei(chan->sid, AL_BUFFERS_PROCESSED, &processed);
+        while (processed-- > 0) {
+            ALuint bid = 0;
+            alSourceUnqueueBuffers(chan->sid, 1, &bid);
+            if (stream_fill(chan->sample, bid)) {
+                alSourceQueueBuffers(chan->sid, 1, &bid);
+            }
+        }
+
+        ALint queued = 0;
+        ALint state = 0;
+        alGetSourcei(chan->sid, AL_BUFFERS_QUEUED, &queued);
+        alGetSourcei(chan->sid, AL_SOURCE_STATE, &state);
+        if (queued == 0) {
+            chan->streaming = false; // played to the end
+        } else if (state == AL_STOPPED) {
+            alSourcePlay(chan->sid); // starved, e.g. during a long load
+        }
+    }
+}
+
 static OPENAL_SAMPLE* OPENAL_GetCurrentSample(int channel)
 {
     if (!initialized) {
@@ -325,6 +521,11 @@ static unsigned int OPENAL_GetLoopMode(int channel)
     if ((channel < 0) || (channel >= (int)num_channels)) {
         return 0;
     }
+    // streams loop by rewinding the decoder, not with AL_LOOPING
+    const OPENAL_SAMPLE* sptr = impl_channels[channel].sample;
+    if (sptr && sptr->stream) {
+        return sptr->mode;
+    }
     ALint loop = 0;
     alGetSourceiv(impl_channels[channel].sid, AL_LOOPING, &loop);
     if (loop) {
@@ -371,10 +572,28 @@ static int OPENAL_PlaySoundEx(int channel, OPENAL_SAMPLE* sptr, OPENAL_DSPUNIT*
     if ((channel < 0) || (channel >= (int)num_channels)) {
         return -1;
     }
-    alSourceStop(impl_channels[channel].sid);
+    const ALuint sid = impl_channels[channel].sid;
+    alSourceStop(sid);
     impl_channels[channel].sample = sptr;
-    alSourcei(impl_channels[channel].sid, AL_BUFFER, sptr->bid);
-    alSourcei(impl_channels[channel].sid, AL_LOOPING, (sptr->mode == OPENAL_LOOP_OFF) ? AL_FALSE : AL_TRUE);
+    impl_channels[channel].streaming = false;
+    if (sptr->stream) {
+        // drops whatever was queued before, then primes the ring from the start
+        alSourcei(sid, AL_BUFFER, 0);
+        alSourcei(sid, AL_LOOPING, AL_FALSE);
+        stream_rewind(sptr);
+        int queued = 0;
+        while (queued < STREAM_BUFFER_COUNT && stream_fill(sptr, sptr->stream->buffers[queued])) {
+            queued++;
+        }
+        if (queued == 0) {
+            return -1;
+        }
+        alSourceQueueBuffers(sid, queued, sptr->stream->buffers);
+        impl_channels[channel].streaming = true;
+    } else {
+        alSourcei(sid, AL_BUFFER, sptr->bid);
+        alSourcei(sid, AL_LOOPING, (sptr->mode == OPENAL_LOOP_OFF) ? AL_FALSE : AL_TRUE);
+    }
     set_channel_position(channel, 0.0f, 0.0f, 0.0f);
 
     impl_channels[channel].startpaused = ((startpaused) ? true : false);
@@ -384,113 +603,6 @@ static int OPENAL_PlaySoundEx(int channel, OPENAL_SAMPLE* sptr, OPENAL_DSPUNIT*
     return channel;
 }
 
-static void* decode_to_pcm(const char* _fname, ALenum& format, ALsizei& size, ALuint& freq)
-{
-#ifdef __POWERPC__
-    const int bigendian = 1;
-#else
-    const int bigendian = 0;
-#endif
-
-    // !!! FIXME: if it's not Ogg, we don't have a decoder. I'm lazy.  :/
-    char* fname = (char*)alloca(strlen(_fname) + 16);
-    strcpy(fname, _fname);
-    char* ptr = strchr(fname, '.');
-    if (ptr) {
-        *ptr = '\0';
-    }
-    strcat(fname, ".ogg");
-
-    /*
-    // just in case...
-    FILE* io = fopen(fname, "rb");
-    if (io == NULL) {
-        return NULL;
-    }
-    */
-
-    ov_callbacks pfs_callbacks;
-    pfs_callbacks.read_func = pfs_read;
-    pfs_callbacks.seek_func = pfs_seek;
-    pfs_callbacks.close_func = pfs_close;
-    pfs_callbacks.tell_func = pfs_tell;
-
-    pfs_handle *pfs_file = new pfs_handle();
-    if(!pfs_file->open(fname)){
-        delete pfs_file;
-        return NULL;
-    }
-
-    ALubyte* retval = NULL;
-
-#if 0 // untested, so disable this!
-    // Can we just feed it to the AL compressed?
-    if (alIsExtensionPresent((const ALubyte *) "AL_EXT_vorbis")) {
-        format = alGetEnumValue((const ALubyte *) "AL_FORMAT_VORBIS_EXT");
-        freq = 44100;
-        fseek(io, 0, SEEK_END);
-        size = ftell(io);
-        fseek(io, 0, SEEK_SET);
-        retval = (ALubyte *) malloc(size);
-        size_t rc = fread(retval, size, 1, io);
-        fclose(io);
-        if (rc != 1) {
-            free(retval);
-            return NULL;
-        }
-        return retval;
-    }
-#endif
-
-    // Uncompress and feed to the AL.
-    OggVorbis_File vf;
-    memset(&vf, '\0', sizeof(vf));
-    //if (ov_open(io, &vf, NULL, 0) == 0) {
-    if (ov_open_callbacks(pfs_file, &vf, NULL, 0, pfs_callbacks) == 0) {
-        int bitstream = 0;
-        vorbis_info* info = ov_info(&vf, -1);
-        size = 0;
-        format = (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-        freq = info->rate;
-
-        if ((info->channels != 1) && (info->channels != 2)) {
-            ov_clear(&vf);
-            return NULL;
-        }
-
-        char buf[1024 * 16];
-        long rc = 0;
-        size_t allocated = 64 * 1024;
-        retval = (ALubyte*)malloc(allocated);
-        if(retval == NULL){
-            LOG("Failed to allocate %d bytes while decoding sound %s", allocated, fname);
-        }
-        while ((rc = ov_read(&vf, buf, sizeof(buf), bigendian, 2, 1, &bitstream)) != 0) {
-            if (rc > 0) {
-                size += rc;
-                if (size >= (int)allocated) {
-                    allocated *= 2;
-                    ALubyte* tmp = (ALubyte*)realloc(retval, allocated);
-                    if (tmp == NULL) {
-                        free(retval);
-                        retval = NULL;
-                        break;
-                    }
-                    retval = tmp;
-                }
-                memcpy(retval + (size - rc), buf, rc);
-            }
-        }
-        ov_clear(&vf);
-        return retval;
-    }
-
-    //fclose(io);
-    pfs_file->close();
-    delete pfs_file;
-    return NULL;
-}
-
 AL_API OPENAL_SAMPLE* OPENAL_Sample_Load(int index, const char* name_or_data, unsigned int mode, int offset, int length)
 {
     if (!initialized) {
@@ -509,34 +621,94 @@ AL_API OPENAL_SAMPLE* OPENAL_Sample_Load(int index, const char* name_or_data, un
         return NULL; // this is all the game does...
     }
 
-    OPENAL_SAMPLE* retval = NULL;
-    ALenum format = AL_NONE;
-    ALsizei size = 0;
-    ALuint frequency = 0;
-    void* data = decode_to_pcm(name_or_data, format, size, frequency);
-    if (data == NULL) {
+    return OPENAL_Sample_Upload(OPENAL_Sample_Decode(name_or_data), mode);
+}
+
+AL_API OPENAL_PCM* OPENAL_Sample_Decode(const char* name)
+{
+    OPENAL_PCM* pcm = new OPENAL_PCM;
+    pcm->data = decode_to_pcm(name, pcm->format, pcm->size, pcm->freq);
+    if (pcm->data == NULL) {
+        delete pcm;
+        return NULL;
+    }
+    pcm->name = new char[strlen(name) + 1];
+    strcpy(pcm->name, name);
+    return pcm;
+}
+
+AL_API OPENAL_SAMPLE* OPENAL_Sample_Upload(OPENAL_PCM* pcm, unsigned int mode)
+{
+    if (pcm == NULL) {
         return NULL;
     }
 
+    OPENAL_SAMPLE* retval = NULL;
     ALuint bid = 0;
     alGetError();
-    alGenBuffers(1, &bid);
-    if (alGetError() == AL_NO_ERROR) {
-        alBufferData(bid, format, data, size, frequency);
+    if (initialized && ((mode == OPENAL_HW3D) || (mode == OPENAL_2D))) {
+        alGenBuffers(1, &bid);
+    }
+    if (bid != 0 && alGetError() == AL_NO_ERROR) {
+        alBufferData(bid, pcm->format, pcm->data, pcm->size, pcm->freq);
         retval = new OPENAL_SAMPLE;
         retval->bid = bid;
         retval->mode = OPENAL_LOOP_OFF;
         retval->is2d = (mode == OPENAL_2D);
-        retval->name = new char[strlen(name_or_data) + 1];
-        if (retval->name) {
-            strcpy(retval->name, name_or_data);
-        }
+        retval->stream = NULL;
+        retval->name = pcm->name; // keeps the decoded name
+        pcm->name = NULL;
     }
 
-    free(data);
+    free(pcm->data);
+    delete[] pcm->name;
+    delete pcm;
     return (retval);
 }
 
+AL_API OPENAL_STREAM* OPENAL_Stream_Open(const char* name, unsigned int mode)
+{
+    if (!initialized) {
+        return NULL;
+    }
+    if ((mode != OPENAL_HW3D) && (mode != OPENAL_2D)) {
+        return NULL; // this is all the game does...
+    }
+
+    OPENAL_STREAM_STATE* stream = new OPENAL_STREAM_STATE;
+    if (!ogg_open(name, stream->vf)) {
+        delete stream;
+        return NULL;
+    }
+
+    vorbis_info* info = ov_info(&stream->vf, -1);
+    if ((info->channels != 1) && (info->channels != 2)) {
+        ov_clear(&stream->vf);
+        delete stream;
+        return NULL;
+    }
+    stream->format = (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    stream->freq = info->rate;
+    stream->eof = false;
+
+    alGetError();
+    alGenBuffers(STREAM_BUFFER_COUNT, stream->buffers);
+    if (alGetError() != AL_NO_ERROR) {
+        ov_clear(&stream->vf);
+        delete stream;
+        return NULL;
+    }
+
+    OPENAL_SAMPLE* retval = new OPENAL_SAMPLE;
+    retval->bid = 0;
+    retval->mode = OPENAL_LOOP_OFF;
+    retval->is2d = (mode == OPENAL_2D);
+    retval->stream = stream;
+    retval->name = new char[strlen(name) + 1];
+    strcpy(retval->name, name);
+    return retval;
+}
+
 AL_API void OPENAL_Sample_Free(OPENAL_SAMPLE* sptr)
 {
     if (!initialized) {
@@ -548,9 +720,16 @@ AL_API void OPENAL_Sample_Free(OPENAL_SAMPLE* sptr)
                 alSourceStop(impl_channels[i].sid);
                 alSourcei(impl_channels[i].sid, AL_BUFFER, 0);
                 impl_channels[i].sample = NULL;
+                impl_channels[i].streaming = false;
             }
         }
-        alDeleteBuffers(1, &sptr->bid);
+        if (sptr->stream) {
+            alDeleteBuffers(STREAM_BUFFER_COUNT, sptr->stream->buffers);
+            ov_clear(&sptr->stream->vf);
+            delete sptr->stream;
+        } else {
+            alDeleteBuffers(1, &sptr->bid);
+        }
         delete[] sptr->name;
         delete sptr;
     }
@@ -681,6 +860,7 @@ AL_API signed char OPENAL_StopSound(int channel)
     }
     alSourceStop(impl_channels[channel].sid);
     impl_channels[channel].startpaused = false;
+    impl_channels[channel].streaming = false;
     return true;
 }
 
@@ -706,6 +886,7 @@ static signed char OPENAL_Stream_Stop(OPENAL_STREAM* stream)
         if (impl_channels[i].sample == (OPENAL_SAMPLE*)stream) {
             alSourceStop(impl_channels[i].sid);
             impl_channels[i].startpaused = false;
+            impl_channels[i].streaming = false;
         }
     }
     return true;
@@ -716,11 +897,17 @@ AL_API signed char OPENAL_Stream_SetMode(OPENAL_STREAM* stream, unsigned int mod
     return OPENAL_Sample_SetMode((OPENAL_SAMPLE*)stream, mode);
 }
 
+AL_API signed char OPENAL_IsInitialized()
+{
+    return initialized;
+}
+
 AL_API void OPENAL_Update()
 {
     if (!initialized) {
         return;
     }
+    stream_update();
     alcProcessContext(alcGetCurrentContext());
 }
 
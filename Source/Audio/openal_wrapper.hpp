@@ -68,6 +68,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #endif /* if 0 */
 
 typedef struct OPENAL_SAMPLE OPENAL_SAMPLE;
+typedef struct OPENAL_PCM OPENAL_PCM;
 typedef OPENAL_SAMPLE OPENAL_STREAM;
 typedef struct OPENAL_DSPUNIT OPENAL_DSPUNIT;
 
@@ -92,6 +93,12 @@ AL_API signed char OPENAL_Init(int mixrate, int maxsoftwarechannels, unsigned in
 AL_API void OPENAL_Close();
 AL_API OPENAL_SAMPLE* OPENAL_Sample_Load(int index, const char* name_or_data, unsigned int mode, int offset, int length);
 AL_API void OPENAL_Sample_Free(OPENAL_SAMPLE* sptr);
+AL_API OPENAL_STREAM* OPENAL_Stream_Open(const char* name, unsigned int mode);
+/* Decode may run on any thread, Upload must run on the thread owning the
+ * AL context and always consumes the OPENAL_PCM */
+AL_API OPENAL_PCM* OPENAL_Sample_Decode(const char* name);
+AL_API OPENAL_SAMPLE* OPENAL_Sample_Upload(OPENAL_PCM* pcm, unsigned int mode);
+AL_API signed char OPENAL_IsInitialized();
 AL_API signed char OPENAL_SetFrequency(int channel, bool slomo = false);
 AL_API signed char OPENAL_SetVolume(int channel, int vol);
 AL_API signed char OPENAL_SetPaused(int channel, signed char paused);
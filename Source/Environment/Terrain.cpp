@@ -27,6 +27,8 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Tutorial.hpp"
 #include "Utils/Folders.hpp"
 
+#include <algorithm>
+
 extern XYZ viewer;
 extern float viewdistance;
 extern float fadestart;
@@ -387,42 +389,14 @@ void Terrain::UpdateVertexArray(int whichx, int whichy)
         heightypatch[whichx][whichy] = size / subdivision * scale;
     }
     avgypatch[whichx][whichy] = (minypatch[whichx][whichy] + maxypatch[whichx][whichy]) / 2;
-
-    for (i = whichx * size / subdivision; i < (whichx + 1) * size / subdivision - 1; i++) {
-        for (j = whichy * size / subdivision; j < (whichy + 1) * size / subdivision - 1; j++) {
-            triangles[(i * (size - 1) * 2) + (j * 2)][0].x = i * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][0].y = heightmap[i][j] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][0].z = j * scale;
-
-            triangles[(i * (size - 1) * 2) + (j * 2)][1].x = i * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][1].y = heightmap[i][j + 1] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][1].z = j * scale + scale;
-
-            triangles[(i * (size - 1) * 2) + (j * 2)][2].x = i * scale + 1 * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][2].y = heightmap[i + 1][j] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2)][2].z = j * scale;
-
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][0].x = i * scale + 1 * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][0].y = heightmap[i + 1][j] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][0].z = j * scale;
-
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][1].x = i * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][1].y = heightmap[i][j + 1] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][1].z = j * scale + 1 * scale;
-
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][2].x = i * scale + 1 * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][2].y = heightmap[i + 1][j + 1] * scale;
-            triangles[(i * (size - 1) * 2) + (j * 2) + 1][2].z = j * scale + 1 * scale;
-        }
-    }
 }
 
 bool Terrain::load(const std::string& fileName)
 {
     MICROPROFILE_SCOPEI("Terrain", "load", 0x50c2aa);
+    finishShadows();
     static long i, j;
     static long x, y;
-    static float patch_size;
 
     float temptexdetail = texdetail;
 
@@ -464,7 +438,7 @@ bool Terrain::load(const std::string& fileName)
 
     texdetail = temptexdetail;
 
-    size = tex_sizeX;
+    resize(tex_sizeX);
 
     for (i = 0; i < size; i++) {
         for (j = 0; j < size; j++) {
@@ -707,8 +681,6 @@ bool Terrain::load(const std::string& fileName)
     }
     Game::LoadingScreen();
 
-    patch_size = size / subdivision;
-    patch_elements = patch_size * patch_size * 54;
     CalculateNormals();
 
     return true;
@@ -987,11 +959,11 @@ XYZ Terrain::getLighting(float pointx, float pointz)
     tilex = pointx;
     tiley = pointz;
 
-    if(tilex + 1 >= max_terrain_size){
-        tilex = max_terrain_size - 2;
+    if(tilex + 1 >= size){
+        tilex = size - 2;
     }
-    if(tiley + 1 >= max_terrain_size){
-        tiley = max_terrain_size - 2;
+    if(tiley + 1 >= size){
+        tiley = size - 2;
     }
 
     height1.x = colors[tilex][tiley][0] * (1 - (pointx - tilex)) + colors[tilex + 1][tiley][0] * (pointx - tilex);
@@ -1012,12 +984,11 @@ void Terrain::draw(int layer)
     static int i, j;
     static float opacity;
     static XYZ terrainpoint;
-    static float distance[subdivision][subdivision];
 
     static int beginx, endx;
     static int beginz, endz;
 
-    static float patch_size = size / subdivision * scale;
+    float patch_size = size / subdivision * scale;
     static float viewdistsquared;
 
     int viewdist = MAX(viewdistance, max_view_distance);
@@ -1052,7 +1023,7 @@ void Terrain::draw(int layer)
                 terrainpoint.x = i * patch_size + (patch_size) / 2;
                 terrainpoint.y = viewer.y; //heightmap[i][j]*scale;
                 terrainpoint.z = j * patch_size + (patch_size) / 2;
-                distance[i][j] = distsq(&viewer, &terrainpoint);
+                patchDistance[i][j] = distsq(&viewer, &terrainpoint);
             }
         }
     }
@@ -1063,23 +1034,23 @@ void Terrain::draw(int layer)
         for (j = beginz; j < endz; j++) {
             MICROPROFILE_SCOPEI("Terrain::draw(int layer)", "procpatch", 0x50c2aa);
 
-            if (distance[i][j] < (viewdist + patch_size) * (viewdist + patch_size)) {
+            if (patchDistance[i][j] < (viewdist + patch_size) * (viewdist + patch_size)) {
                 opacity = 1;
-                if (distance[i][j] > viewdistsquared * fadestart - viewdistsquared) {
+                if (patchDistance[i][j] > viewdistsquared * fadestart - viewdistsquared) {
                     opacity = 0;
                 }
                 if (opacity == 1 && i != subdivision) {
-                    if (distance[i + 1][j] > viewdistsquared * fadestart - viewdistsquared) {
+                    if (patchDistance[i + 1][j] > viewdistsquared * fadestart - viewdistsquared) {
                         opacity = 0;
                     }
                 }
                 if (opacity == 1 && j != subdivision) {
-                    if (distance[i][j + 1] > viewdistsquared * fadestart - viewdistsquared) {
+                    if (patchDistance[i][j + 1] > viewdistsquared * fadestart - viewdistsquared) {
                         opacity = 0;
                     }
                 }
                 if (opacity == 1 && j != subdivision && i != subdivision) {
-                    if (distance[i + 1][j + 1] > viewdistsquared * fadestart - viewdistsquared) {
+                    if (patchDistance[i + 1][j + 1] > viewdistsquared * fadestart - viewdistsquared) {
                         opacity = 0;
                     }
                 }
@@ -1095,7 +1066,7 @@ void Terrain::draw(int layer)
                 if (cubeInFrustum) {
                     /*
                     //VITAGL: TODO
-                    if (environment == desertenvironment && distance[i][j] > viewdistsquared / 4) {
+                    if (environment == desertenvironment && patchDistance[i][j] > viewdistsquared / 4) {
                         glTexEnvf(GL_TEXTURE_FILTER_CONTROL_EXT, GL_TEXTURE_LOD_BIAS_EXT, blurness);
                     } else if (environment == desertenvironment) {
                         glTexEnvf(GL_TEXTURE_FILTER_CONTROL_EXT, GL_TEXTURE_LOD_BIAS_EXT, 0);
@@ -1301,44 +1272,120 @@ void Terrain::AddObject(XYZ where, float radius, int id)
 {
     XYZ points[2];
     if (id >= 0 && id < 10000) {
-        for (int i = 0; i < subdivision; i++) {
-            for (int j = 0; j < subdivision; j++) {
+        if (id >= (int)objectHandles.size()) {
+            objectHandles.resize(id + 1, -1);
+        } else if (objectHandles[id] != -1) {
+            /* Re-adding an object moves it instead of listing it twice */
+            removeObjectPatches(objectHandles[id]);
+            objectHandles[id] = -1;
+        }
+
+        ObjectPatches added;
+        added.index = id;
+        added.minx = subdivision;
+        added.miny = subdivision;
+        added.maxx = -1;
+        added.maxy = -1;
+        added.where = where;
+        added.radius = radius;
+
+        /* Only look at the patches around the object's rectangle, the exact test below still decides */
+        int firstx = 0, lastx = subdivision - 1;
+        int firsty = 0, lasty = subdivision - 1;
+        float patchsize = (size / subdivision) * scale;
+        if (patchsize > 0) {
+            if (!(fabs(where.x) + radius < 1e9f && fabs(where.z) + radius < 1e9f)) {
+                return;
+            }
+            firstx = std::max(firstx, (int)floor((where.x - radius) / patchsize) - 1);
+            lastx = std::min(lastx, (int)floor((where.x + radius) / patchsize) + 1);
+            firsty = std::max(firsty, (int)floor((where.z - radius) / patchsize) - 1);
+            lasty = std::min(lasty, (int)floor((where.z + radius) / patchsize) + 1);
+        }
+
+        unsigned int handle = objectPatches.size();
+        if (!freeObjectPatches.empty()) {
+            handle = freeObjectPatches.back();
+            freeObjectPatches.pop_back();
+        }
+        for (int i = firstx; i <= lastx; i++) {
+            for (int j = firsty; j <= lasty; j++) {
                 if (patchobjects[i][j].size() < 300 - 1) {
                     points[0].x = (size / subdivision) * i;
                     points[0].z = (size / subdivision) * j;
-                    points[0].y = heightmap[(int)points[0].x][(int)points[0].z];
                     points[1].x = (size / subdivision) * (i + 1);
                     points[1].z = (size / subdivision) * (j + 1);
-                    points[1].y = heightmap[(int)points[1].x][(int)points[1].z];
                     points[0] *= scale;
                     points[1] *= scale;
                     if (where.x + radius > points[0].x && where.x - radius < points[1].x && where.z + radius > points[0].z && where.z - radius < points[1].z) {
-                        patchobjects[i][j].push_back(id);
+                        patchobjects[i][j].push_back(handle);
+                        added.minx = std::min(added.minx, i);
+                        added.miny = std::min(added.miny, j);
+                        added.maxx = std::max(added.maxx, i);
+                        added.maxy = std::max(added.maxy, j);
                     }
                 }
             }
         }
+
+        objectHandles[id] = handle;
+        if (handle < objectPatches.size()) {
+            objectPatches[handle] = added;
+        } else {
+            objectPatches.push_back(added);
+        }
     }
 }
 
+void Terrain::removeObjectPatches(int handle)
+{
+    ObjectPatches& removed = objectPatches[handle];
+    for (int i = removed.minx; i <= removed.maxx; i++) {
+        for (int j = removed.miny; j <= removed.maxy; j++) {
+            std::vector<unsigned int>& list = patchobjects[i][j];
+            list.erase(std::remove(list.begin(), list.end(), (unsigned int)handle), list.end());
+        }
+    }
+    removed.index = -1;
+    freeObjectPatches.push_back(handle);
+}
+
 void Terrain::DeleteObject(unsigned int id)
+{
+    if (id >= objectHandles.size()) {
+        return;
+    }
+
+    if (objectHandles[id] != -1) {
+        removeObjectPatches(objectHandles[id]);
+    }
+
+    /* Objects after it move down one slot but keep their handles */
+    objectHandles.erase(objectHandles.begin() + id);
+    for (unsigned int k = id; k < objectHandles.size(); k++) {
+        if (objectHandles[k] != -1) {
+            objectPatches[objectHandles[k]].index = k;
+        }
+    }
+}
+
+void Terrain::clearObjects()
 {
     for (int i = 0; i < subdivision; i++) {
         for (int j = 0; j < subdivision; j++) {
-            for (unsigned int k = 0; k < patchobjects[i][j].size();) {
-                if (patchobjects[i][j][k] == id) {
-                    /* Remove all occurences of id (there should never be more than 1 though) */
-                    patchobjects[i][j].erase(patchobjects[i][j].begin() + k);
-                } else {
-                    /* Update id of other objects if needed */
-                    if (patchobjects[i][j][k] > id) {
-                        patchobjects[i][j][k]--;
-                    }
-                    k++;
-                }
-            }
+            patchobjects[i][j].clear();
         }
     }
+    objectPatches.clear();
+    objectHandles.clear();
+    freeObjectPatches.clear();
+}
+
+unsigned int Terrain::patchObject(int whichx, int whichy, unsigned int n) const
+{
+    int index = objectPatches[patchobjects[whichx][whichy][n]].index;
+    ASSERT(index >= 0);
+    return index;
 }
 
 void Terrain::DeleteDecal(int which)
@@ -1430,12 +1477,46 @@ void Terrain::MakeDecalLock(decal_type type, XYZ where, int whichx, int whichy,
     }
 }
 
+#define SHADOW_ROWS_PER_JOB 16
+
+struct TerrainShadowJob: WorkerThread::Job {
+    Terrain *terrain;
+    int first, last;
+    XYZ lightloc;
+    Light lightcolors;
+    TerrainShadowJob(Terrain *t, int f, int l, XYZ loc, Light lc):
+        Job(),
+        terrain(t),
+        first(f),
+        last(l),
+        lightloc(loc),
+        lightcolors(lc)
+    {
+        //--
+    }
+    void execute() override {
+        MICROPROFILE_SCOPEI("Terrain", "TerrainShadowJob", 0x50c2aa);
+        terrain->DoShadowRows(first, last, lightloc, lightcolors);
+    }
+};
+
+/* bakes shadows and lighting into colors (and vArray) before returning */
 void Terrain::DoShadows()
 {
-    MICROPROFILE_SCOPEI("Terrain", "DoShadows", 0x50c2aa);
+    submitShadowJobs();
+    finishShadows();
+}
 
-    static XYZ testpoint, testpoint2, terrainpoint, lightloc, col;
-    lightloc = light.location;
+/**
+ * Starts baking shadows on the worker threads, one band of rows per job.
+ * Objects and the heightmap must not change until finishShadows().
+ * */
+void Terrain::submitShadowJobs()
+{
+    MICROPROFILE_SCOPEI("Terrain", "submitShadowJobs", 0x50c2aa);
+    finishShadows();
+
+    XYZ lightloc = light.location;
     if (!skyboxtexture) {
         lightloc.x = 0;
         lightloc.z = 0;
@@ -1444,11 +1525,21 @@ void Terrain::DoShadows()
         lightloc.x *= .4;
         lightloc.z *= .4;
     }
+    Normalise(&lightloc);
+
+    for (int i = 0; i < size; i += SHADOW_ROWS_PER_JOB) {
+        int last = std::min(i + SHADOW_ROWS_PER_JOB, (int)size) - 1;
+        shadowJobs.push_back(WorkerThread::submitJob<TerrainShadowJob>(this, i, last, lightloc, light));
+    }
+}
+
+void Terrain::DoShadowRows(int first, int last, XYZ lightloc, const Light& lightcolors)
+{
+    XYZ testpoint, testpoint2, terrainpoint, col;
     int patchx, patchz;
     float shadowed;
-    Normalise(&lightloc);
     //Calculate shadows
-    for (short int i = 0; i < size; i++) {
+    for (short int i = first; i <= last; i++) {
         for (short int j = 0; j < size; j++) {
             terrainpoint.x = (float)i * scale;
             terrainpoint.z = (float)j * scale;
@@ -1459,7 +1550,7 @@ void Terrain::DoShadows()
             patchz = (float)j * subdivision / size;
             if (patchobjects[patchx][patchz].size()) {
                 for (unsigned int k = 0; k < patchobjects[patchx][patchz].size(); k++) {
-                    unsigned int l = patchobjects[patchx][patchz][k];
+                    unsigned int l = patchObject(patchx, patchz, k);
                     if (Object::objects[l]->type != treetrunktype) {
                         testpoint = terrainpoint;
                         testpoint2 = terrainpoint + lightloc * 50 * (1 - shadowed);
@@ -1468,7 +1559,6 @@ void Terrain::DoShadows()
                         }
                     }
                 }
-                Game::LoadingScreen();
             }
             float brightness = dotproduct(&lightloc, &normals[i][j]);
             if (shadowed) {
@@ -1482,9 +1572,9 @@ void Terrain::DoShadows()
                 brightness = 0;
             }
 
-            colors[i][j][0] = light.color[0] * brightness + light.ambient[0];
-            colors[i][j][1] = light.color[1] * brightness + light.ambient[1];
-            colors[i][j][2] = light.color[2] * brightness + light.ambient[2];
+            colors[i][j][0] = lightcolors.color[0] * brightness + lightcolors.ambient[0];
+            colors[i][j][1] = lightcolors.color[1] * brightness + lightcolors.ambient[1];
+            colors[i][j][2] = lightcolors.color[2] * brightness + lightcolors.ambient[2];
 
             if (colors[i][j][0] > 1) {
                 colors[i][j][0] = 1;
@@ -1506,6 +1596,27 @@ void Terrain::DoShadows()
             }
         }
     }
+}
+
+/**
+ * Waits for the shadow jobs (keeping the loading screen alive), then
+ * smooths the result and rebuilds the vertex arrays. Does nothing if no
+ * bake is running.
+ * */
+void Terrain::finishShadows()
+{
+    if (shadowJobs.empty()) {
+        return;
+    }
+    MICROPROFILE_SCOPEI("Terrain", "finishShadows", 0x50c2aa);
+
+    for (auto& job : shadowJobs) {
+        if (!WorkerThread::tryJoin(job)) {
+            Game::LoadingScreen();
+            WorkerThread::join(job, true);
+        }
+    }
+    shadowJobs.clear();
 
     Game::LoadingScreen();
 
@@ -1555,60 +1666,108 @@ void Terrain::DoShadows()
         }
     }
 
-    for (unsigned int i = 0; i < subdivision; i++) {
-        for (unsigned int j = 0; j < subdivision; j++) {
+    for (int i = 0; i < subdivision; i++) {
+        for (int j = 0; j < subdivision; j++) {
             UpdateVertexArray(i, j);
         }
     }
 }
 
+/* makes sure vArray has room for every patch at the current size */
 bool Terrain::allocate(){
-    ASSERT(vArray == nullptr && "Called allocate more than once");
-    if(vArray != nullptr){
-        return false;
+    int needed = patch_elements * subdivision * subdivision;
+    if(vArray != nullptr && needed <= vArraySize){
+        return true;
+    }
+    if(needed == 0){
+        return true;
     }
 
-    int vArraySize = ((max_patch_elements)*subdivision*subdivision) * sizeof(GLfloat);
-
+    if(vArray != nullptr){
+#ifdef DRAW_SPEEDHACK
+        vgl_free(vArray);
+#else
+        free(vArray);
+#endif
+        vArray = nullptr;
+        vArraySize = 0;
+    }
 
 #ifdef DRAW_SPEEDHACK    
-    vArray = (GLfloat*) gpu_alloc_mapped(vArraySize, VGL_MEM_VRAM);
+    vArray = (GLfloat*) gpu_alloc_mapped(needed * sizeof(GLfloat), VGL_MEM_VRAM);
 #else
-    vArray = (GLfloat*) malloc(vArraySize);
+    vArray = (GLfloat*) malloc(needed * sizeof(GLfloat));
 #endif
     ASSERT(vArray != nullptr && "Failed to allocate memory for Terrain");
-    memset(vArray, 0, vArraySize);
+    if(vArray == nullptr){
+        return false;
+    }
+    memset(vArray, 0, needed * sizeof(GLfloat));
+    vArraySize = needed;
 
-    return vArray != nullptr;
+    return true;
 }
 
-Terrain::Terrain():
-    vArray(nullptr)
+/**
+ * Sizes the terrain data for a newsize x newsize heightmap, with one patch
+ * per terrain_patch_size cells. Objects already on the terrain are put back
+ * into the new patches if the subdivision changes.
+ * */
+void Terrain::resize(int newsize)
 {
-    size = 0;
+    if (newsize != size) {
+        size = newsize;
+        // one extra row and column, patches read the vertex after their last cell
+        heightmap.resize(size + 1, size + 1);
+        normals.resize(size + 1, size + 1);
+        facenormals.resize(size + 1, size + 1);
+        colors.resize(size + 1, size + 1);
+        opacityother.resize(size + 1, size + 1);
+        texoffsetx.resize(size + 1, size + 1);
+        texoffsety.resize(size + 1, size + 1);
+    }
+
+    int newsubdivision = std::max(1, newsize / terrain_patch_size);
+    if (newsubdivision != subdivision) {
+        std::vector<ObjectPatches> added;
+        for (unsigned int k = 0; k < objectHandles.size(); k++) {
+            if (objectHandles[k] != -1) {
+                added.push_back(objectPatches[objectHandles[k]]);
+            }
+        }
+        clearObjects();
+
+        subdivision = newsubdivision;
+        patchobjects.resize(subdivision, subdivision);
+        numtris.resize(subdivision, subdivision);
+        textureness.resize(subdivision, subdivision);
+        avgypatch.resize(subdivision, subdivision);
+        maxypatch.resize(subdivision, subdivision);
+        minypatch.resize(subdivision, subdivision);
+        heightypatch.resize(subdivision, subdivision);
+        patchDistance.resize(subdivision + 1, subdivision + 1);
+
+        for (auto& object : added) {
+            AddObject(object.where, object.radius, object.index);
+        }
+    }
 
+    int patch_size = size / subdivision;
+    patch_elements = patch_size * patch_size * 54;
+    allocate();
+}
+
+Terrain::Terrain():
+    size(-1),
+    subdivision(0),
+    vArray(nullptr),
+    vArraySize(0)
+{
     decals.reserve(max_decals);
 
     scale = 1.0f;
     type = 0;
-    memset(heightmap, 0, sizeof(heightmap));
-    memset(normals, 0, sizeof(normals));
-    memset(facenormals, 0, sizeof(facenormals));
-    memset(triangles, 0, sizeof(triangles));
-    memset(colors, 0, sizeof(colors));
-    memset(opacityother, 0, sizeof(opacityother));
-    memset(texoffsetx, 0, sizeof(texoffsetx));
-    memset(texoffsety, 0, sizeof(texoffsety));
-    memset(numtris, 0, sizeof(numtris));
-    memset(textureness, 0, sizeof(textureness));
-
-    //memset(vArray, 0, sizeof(vArray));
-
-    memset(visible, 0, sizeof(visible));
-    memset(avgypatch, 0, sizeof(avgypatch));
-    memset(maxypatch, 0, sizeof(maxypatch));
-    memset(minypatch, 0, sizeof(minypatch));
-    memset(heightypatch, 0, sizeof(heightypatch));
-
     patch_elements = 0;
+
+    resize(0);
 }
@@ -28,11 +28,12 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Math/Frustum.hpp"
 #include "Math/XYZ.hpp"
 #include "Utils/ImageIO.hpp"
+#include "Utils/WorkerThread.hpp"
+
+#include <vector>
 
-#define max_terrain_size 256
 #define curr_terrain_size size
-#define subdivision 64
-#define max_patch_elements (max_terrain_size / subdivision) * (max_terrain_size / subdivision) * 54
+#define terrain_patch_size 4 // heightmap cells along each side of a patch
 
 #define allfirst 0
 #define mixed 1
@@ -47,6 +48,41 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 // Model Structures
 //
 
+/**
+ * Row-major 2D array sized at runtime, indexed like a plain array with
+ * grid[x][y]. Used for the per-vertex and per-patch terrain data so it can
+ * follow the size of the loaded heightmap.
+ * */
+template <typename T>
+class TerrainArray
+{
+public:
+    TerrainArray()
+        : height(0)
+    {
+    }
+
+    void resize(int x, int y)
+    {
+        height = y;
+        data.assign(x * y, T());
+    }
+
+    T* operator[](int x) { return &data[x * height]; }
+    const T* operator[](int x) const { return &data[x * height]; }
+
+private:
+    std::vector<T> data;
+    int height;
+};
+
+struct TerrainColor
+{
+    float c[4];
+    float& operator[](int i) { return c[i]; }
+    const float& operator[](int i) const { return c[i]; }
+};
+
 class Terrain
 {
 public:
@@ -58,31 +94,30 @@ public:
     Texture breaktexture;
     Texture terraintexture;
     short size;
+    int subdivision; // patches along each side, chosen from size on load
 
-    std::vector<unsigned int> patchobjects[subdivision][subdivision];
+    /* object handles per patch, patchObject() maps them to Object::objects */
+    TerrainArray<std::vector<unsigned int>> patchobjects;
 
     float scale;
     int type;
-    float heightmap[max_terrain_size + 1][max_terrain_size + 1];
-    XYZ normals[max_terrain_size][max_terrain_size];
-    XYZ facenormals[max_terrain_size][max_terrain_size];
-    XYZ triangles[(max_terrain_size - 1) * (max_terrain_size - 1) * 2][3];
-    float colors[max_terrain_size][max_terrain_size][4];
-    float opacityother[max_terrain_size][max_terrain_size];
-    float texoffsetx[max_terrain_size][max_terrain_size];
-    float texoffsety[max_terrain_size][max_terrain_size];
-    int numtris[subdivision][subdivision];
-    int textureness[subdivision][subdivision];
-
-    //GLfloat vArray[(max_patch_elements)*subdivision * subdivision];
+    TerrainArray<float> heightmap;
+    TerrainArray<XYZ> normals;
+    TerrainArray<XYZ> facenormals;
+    TerrainArray<TerrainColor> colors;
+    TerrainArray<float> opacityother;
+    TerrainArray<float> texoffsetx;
+    TerrainArray<float> texoffsety;
+    TerrainArray<int> numtris;
+    TerrainArray<int> textureness;
+
     GLfloat *vArray;
     bool allocate();
 
-    bool visible[subdivision][subdivision];
-    float avgypatch[subdivision][subdivision];
-    float maxypatch[subdivision][subdivision];
-    float minypatch[subdivision][subdivision];
-    float heightypatch[subdivision][subdivision];
+    TerrainArray<float> avgypatch;
+    TerrainArray<float> maxypatch;
+    TerrainArray<float> minypatch;
+    TerrainArray<float> heightypatch;
 
     int patch_elements;
 
@@ -90,6 +125,8 @@ public:
 
     void AddObject(XYZ where, float radius, int id);
     void DeleteObject(unsigned int id);
+    void clearObjects();
+    unsigned int patchObject(int whichx, int whichy, unsigned int n) const;
     void DeleteDecal(int which);
     void MakeDecal(decal_type type, XYZ where, float size, float opacity, float rotation);
     void MakeDecalLock(decal_type type, XYZ where, int whichx, int whichy, float size, float opacity, float rotation);
@@ -104,6 +141,9 @@ public:
     void drawdecals();
     void draw(int layer);
     void DoShadows();
+    void submitShadowJobs();
+    void finishShadows();
+    void DoShadowRows(int first, int last, XYZ lightloc, const Light& lightcolors);
     void deleteDeadDecals();
 
     Terrain();
@@ -115,6 +155,30 @@ private:
     void UpdateTransparency(int whichx, int whichy);
     void UpdateTransparencyother(int whichx, int whichy);
     void UpdateTransparencyotherother(int whichx, int whichy);
+
+    void resize(int newsize);
+    void removeObjectPatches(int handle);
+
+    int vArraySize; // floats allocated for vArray
+    TerrainArray<float> patchDistance;
+
+    std::vector<WorkerThread::JobHandle> shadowJobs;
+
+    /**
+     * Handles stay the same for the lifetime of an object, so deleting one
+     * only touches the patches it was added to and renumbers these flat
+     * tables instead of every patch list
+     * */
+    struct ObjectPatches
+    {
+        int index; // into Object::objects, -1 once deleted
+        int minx, miny, maxx, maxy;
+        XYZ where; // kept to redo the patches when subdivision changes
+        float radius;
+    };
+    std::vector<ObjectPatches> objectPatches; // by handle
+    std::vector<int> objectHandles;           // by object index, -1 if not on the terrain
+    std::vector<int> freeObjectPatches;       // removed handles, reused before the table grows
 };
 
 #endif
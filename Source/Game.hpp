@@ -153,6 +153,7 @@ void ResetBeforeLevelLoad(bool tutorial);
 bool LoadLevel(int which);
 bool LoadLevel(const std::string& name, bool tutorial = false);
 bool LoadJsonLevel(const std::string& name, bool tutorial = false);
+bool LoadBinaryLevel(const std::string& name, bool tutorial = false);
 
 void cmd_dispatch(const string cmd);
 
@@ -241,10 +242,17 @@ enum optionIndex
     OPENALINFO,
     SHOWRESOLUTIONS,
     DEVTOOLS,
-    CMD
+    CMD,
+    BENCHMARK,
+    BENCHMARKFRAMES,
+    BENCHMARKOUT,
+    RECORDINPUT,
+    REPLAYINPUT,
+    WORKERS,
+    PINTHREADS
 };
 /* Number of options + 1 */
-const int commandLineOptionsNumber = 11;
+const int commandLineOptionsNumber = 18;
 
 extern const option::Descriptor usage[];
 
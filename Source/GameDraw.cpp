@@ -378,7 +378,7 @@ int Game::DrawGLScene(StereoSide side)
                             }
                             terrain.MakeDecal(shadowdecal, point, size, opacity, rotation);
                             for (unsigned int l = 0; l < terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz].size(); l++) {
-                                unsigned int j = terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz][l];
+                                unsigned int j = terrain.patchObject(Person::players[k]->whichpatchx, Person::players[k]->whichpatchz, l);
                                 if (Object::objects[j]->position.y < Person::players[k]->coords.y || Object::objects[j]->type == tunneltype || Object::objects[j]->type == weirdtype) {
                                     point = DoRotation(DoRotation(Person::players[k]->skeleton.joints[i].position, 0, Person::players[k]->yaw, 0) * Person::players[k]->scale + Person::players[k]->coords - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
                                     size = .4f;
@@ -409,7 +409,7 @@ int Game::DrawGLScene(StereoSide side)
                             }
                             terrain.MakeDecal(shadowdecal, point, size, opacity * .7, rotation);
                             for (unsigned int l = 0; l < terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz].size(); l++) {
-                                unsigned int j = terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz][l];
+                                unsigned int j = terrain.patchObject(Person::players[k]->whichpatchx, Person::players[k]->whichpatchz, l);
                                 if (Object::objects[j]->position.y < Person::players[k]->coords.y || Object::objects[j]->type == tunneltype || Object::objects[j]->type == weirdtype) {
                                     if (Person::players[k]->skeleton.free) {
                                         point = DoRotation(Person::players[k]->skeleton.joints[i].position * Person::players[k]->scale + Person::players[k]->coords - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
@@ -438,7 +438,7 @@ int Game::DrawGLScene(StereoSide side)
                     for (unsigned int l = 0; l < terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz].size(); l++) {
                         int patchx = Person::players[k]->whichpatchx;
                         int patchz = Person::players[k]->whichpatchz;
-                        unsigned int j = terrain.patchobjects[patchx][patchz][l];
+                        unsigned int j = terrain.patchObject(patchx, patchz, l);
                         point = DoRotation(Person::players[k]->coords - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
                         size = .7;
                         opacity = .4f;
@@ -457,7 +457,7 @@ int Game::DrawGLScene(StereoSide side)
         for (unsigned int l = 0; l < terrain.patchobjects[p1->whichpatchx][p1->whichpatchz].size(); l++) {
             int patchx = p1->whichpatchx;
             int patchz = p1->whichpatchz;
-            unsigned int j = terrain.patchobjects[patchx][patchz][l];
+            unsigned int j = terrain.patchObject(patchx, patchz, l);
             point = DoRotation(p1->coords - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
             size = .7;
             opacity = .4f;
@@ -548,10 +548,10 @@ int Game::DrawGLScene(StereoSide side)
 
             std::vector<WorkerThread::JobHandle> wtjobs;
             
-            //Phase 1
+            //normals and vertex arrays, chained on each skeleton job
             for(int i = 0; i < num_draw_targs; i++){
                 ASSERT(hndl_skeleton[i] != -1);
-                Person::players[draw_targets[i]]->submitCalculateNormalsJobs(1, hndl_skeleton[i], wtjobs);
+                Person::players[draw_targets[i]]->submitCalculateNormalsJobs(hndl_skeleton[i], wtjobs);
             }
 
             //join update skeleton jobs
@@ -561,24 +561,6 @@ int Game::DrawGLScene(StereoSide side)
                 WorkerThread::join(hndl_skeleton[i], true);
             }
 
-            for(auto job: wtjobs){
-                WorkerThread::join(job, true);
-            }
-            wtjobs.clear();
-
-            //Phase 2
-            for(int i = 0; i < num_draw_targs; i++){
-                Person::players[draw_targets[i]]->submitCalculateNormalsJobs(2, -1, wtjobs);
-            }
-            for(auto job: wtjobs){
-                WorkerThread::join(job, true);
-            }
-            wtjobs.clear();
-
-            //Phase 3
-            for(int i = 0; i < num_draw_targs; i++){
-                Person::players[draw_targets[i]]->submitCalculateNormalsJobs(3, -1, wtjobs);
-            }
             for(auto job: wtjobs){
                 WorkerThread::join(job, true);
             }
@@ -710,6 +692,9 @@ int Game::DrawGLScene(StereoSide side)
             WorkerThread::join(spritejobs[i], true);
         }
         Sprite::Draw();
+        // spawned sprites have no draw position until they're animated,
+        // and blood hits paint decals the terrain pass below draws
+        Sprite::flushSpawnQueues();
 }//MICROPROFILE
 
 {MICROPROFILE_SCOPEI("DrawGLScene", "terrain-decals", 0xb500ff);
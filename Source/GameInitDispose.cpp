@@ -217,6 +217,7 @@ void Dispose()
 
     OPENAL_StopSound(OPENAL_ALL);
 
+    finishSoundLoading();
     for (int i = 0; i < sounds_count; ++i) {
         OPENAL_Sample_Free(samp[i]);
     }
@@ -722,9 +723,12 @@ void Game::InitGame()
         texdetail = 4;
     }
 
-    LOG("Initializing sound system...");
+    // without an initialized device every OPENAL_* call is a no-op
+    if (!commandLineOptions[SOUND] && !commandLineOptions[BENCHMARK]) {
+        LOG("Initializing sound system...");
 
-    OPENAL_Init(44100, 32, 0);
+        OPENAL_Init(44100, 32, 0);
+    }
 
     OPENAL_SetSFXMasterVolume((int)(volume * 255));
     loadAllSounds();
@@ -28,6 +28,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Animation/Animation.hpp"
 #include "Audio/openal_wrapper.hpp"
 #include "Devtools/ConsoleCmds.hpp"
+#include "Graphic/ClothesCompositor.hpp"
 #include "Level/Awards.hpp"
 #include "Level/Campaign.hpp"
 #include "Level/Dialog.hpp"
@@ -581,10 +582,16 @@ void Game::ResetBeforeLevelLoad(bool tutorial)
 bool Game::LoadLevel(const std::string& name, bool tutorial)
 {
     MICROPROFILE_SCOPEI("GameTick", "LoadLevel", 0xfe239f);
-    if (LoadJsonLevel(name, tutorial)) {
-        // Try JSON loading first, binary is fallback
-        return true;
-    }
+    // Try JSON loading first, binary is fallback
+    bool loaded = LoadJsonLevel(name, tutorial) || LoadBinaryLevel(name, tutorial);
+    //finished skins are only shared between the persons of one level
+    ClothesCompositor::clearCache();
+    return loaded;
+}
+
+bool Game::LoadBinaryLevel(const std::string& name, bool tutorial)
+{
+    MICROPROFILE_SCOPEI("GameTick", "LoadBinaryLevel", 0xfe239f);
     const std::string level_path = Folders::getResourcePath("Maps/" + name);
     if (!Folders::file_exists(level_path)) {
         LOG("LoadLevel: Could not open file: %s", level_path.c_str());
@@ -633,11 +640,7 @@ bool Game::LoadLevel(const std::string& name, bool tutorial)
         terrain.decals.clear();
         Sprite::deleteSprites();
 
-        for (int i = 0; i < subdivision; i++) {
-            for (int j = 0; j < subdivision; j++) {
-                terrain.patchobjects[i][j].clear();
-            }
-        }
+        terrain.clearObjects();
         Game::LoadingScreen();
     }
 
@@ -823,8 +826,8 @@ bool Game::LoadLevel(const std::string& name, bool tutorial)
 
     if (!stealthloading) {
         Object::AddObjectsToTerrain();
-        terrain.DoShadows();
-        Game::LoadingScreen();
+        //finished at the end of the load
+        terrain.submitShadowJobs();
         Object::DoShadows();
         Game::LoadingScreen();
     }
@@ -961,6 +964,8 @@ bool Game::LoadLevel(const std::string& name, bool tutorial)
     oldmusicvolume[2] = 0;
     oldmusicvolume[3] = 0;
 
+    terrain.finishShadows();
+
     leveltime = 0;
     wonleveltime = 0;
     visibleloading = false;
@@ -1016,11 +1021,7 @@ bool Game::LoadJsonLevel(const std::string& name, bool tutorial)
         terrain.decals.clear();
         Sprite::deleteSprites();
 
-        for (int i = 0; i < subdivision; i++) {
-            for (int j = 0; j < subdivision; j++) {
-                terrain.patchobjects[i][j].clear();
-            }
-        }
+        terrain.clearObjects();
         Game::LoadingScreen();
     }
 
@@ -1122,8 +1123,8 @@ bool Game::LoadJsonLevel(const std::string& name, bool tutorial)
 
     if (!stealthloading) {
         Object::AddObjectsToTerrain();
-        terrain.DoShadows();
-        Game::LoadingScreen();
+        //finished at the end of the load
+        terrain.submitShadowJobs();
         Object::DoShadows();
         Game::LoadingScreen();
     }
@@ -1233,6 +1234,8 @@ bool Game::LoadJsonLevel(const std::string& name, bool tutorial)
     oldmusicvolume[2] = 0;
     oldmusicvolume[3] = 0;
 
+    terrain.finishShadows();
+
     leveltime = 0;
     wonleveltime = 0;
     visibleloading = false;
@@ -1517,6 +1520,7 @@ void Game::ProcessDevInput()
             }
 
             Person::players[closest]->addClothes();
+            ClothesCompositor::clearCache();
         }
 
         /* Change creature type */
@@ -1783,6 +1787,7 @@ void Game::ProcessDevInput()
                 Person::players.back()->clothestintb.push_back(Person::players[0]->clothestintb[i]);
             }
             Person::players.back()->addClothes();
+            ClothesCompositor::clearCache();
 
             Person::players.back()->power = Person::players[0]->power;
             Person::players.back()->speedmult = Person::players[0]->speedmult;
@@ -1950,11 +1955,41 @@ void Game::ProcessDevInput()
     }
 }
 
+/* called once a pair from a Person::grid query has been handled: puts both
+ * players back in the right cell, and if k itself was moved, queries again
+ * around its new coords and points n at the last slot handled so far (k is
+ * always in its own result, so that never underflows) */
+static void syncPlayerPair(unsigned k, unsigned i, float radius, XYZ& center, std::vector<unsigned>& nearby, unsigned& n)
+{
+    Person::grid.move(i, Person::players[i]->coords);
+    Person::grid.move(k, Person::players[k]->coords);
+    if (Person::players[k]->coords.x != center.x || Person::players[k]->coords.z != center.z) {
+        center = Person::players[k]->coords;
+        Person::grid.query(center, radius, nearby);
+        n = std::upper_bound(nearby.begin(), nearby.end(), i) - nearby.begin() - 1;
+    }
+}
+
 void doJumpReversals()
 {
     MICROPROFILE_SCOPEI("Game", "doJumpReversals", 0xff008f);
+    static std::vector<unsigned> nearby;
+    float maxscale = 0;
     for (unsigned k = 0; k < Person::players.size(); k++) {
-        for (unsigned i = k + 1; i < Person::players.size(); i++) {
+        maxscale = std::max(maxscale, Person::players[k]->scale);
+    }
+    // widest flat distance the test below can accept
+    const float reach = sqrtf(2) * maxscale * 2 * 2.5;
+
+    Person::updateGrid();
+    for (unsigned k = 0; k < Person::players.size(); k++) {
+        XYZ center = Person::players[k]->coords;
+        Person::grid.query(center, reach, nearby);
+        for (unsigned n = 0; n < nearby.size(); n++) {
+            const unsigned i = nearby[n];
+            if (i <= k) {
+                continue;
+            }
             if (Person::players[k]->skeleton.free == 0 &&
                 Person::players[i]->skeleton.oldfree == 0 &&
                 (Person::players[i]->animTarget == jumpupanim ||
@@ -2048,6 +2083,7 @@ void doJumpReversals()
                     }
                 }
             }
+            syncPlayerPair(k, i, reach, center, nearby, n);
         }
     }
 }
@@ -2117,7 +2153,7 @@ void doAerialAcrobatics()
             Person::players[k]->coords.y = max(Person::players[k]->coords.y, th);
             //Huge hotspot here when there are many objects + players
             for (unsigned int l = 0; l < terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz].size(); l++) {
-                unsigned int i = terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz][l];
+                unsigned int i = terrain.patchObject(Person::players[k]->whichpatchx, Person::players[k]->whichpatchz, l);
                 if (Object::objects[i]->type != rocktype ||
                     Object::objects[i]->scale > .5 && Person::players[k]->isPlayerControlled() ||
                     Object::objects[i]->position.y > Person::players[k]->coords.y) {
@@ -2284,7 +2320,7 @@ void doAerialAcrobatics()
 
             if (tempcollide) {
                 for (unsigned int l = 0; l < terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz].size(); l++) {
-                    int i = terrain.patchobjects[Person::players[k]->whichpatchx][Person::players[k]->whichpatchz][l];
+                    int i = terrain.patchObject(Person::players[k]->whichpatchx, Person::players[k]->whichpatchz, l);
                     lowpoint = Person::players[k]->coords;
                     lowpoint.y += 1.35;
                     if (Object::objects[i]->type != rocktype) {
@@ -2504,6 +2540,7 @@ void doAttacks()
         Person::players[0]->attackkeydown = 0;
     }
 
+    static std::vector<unsigned> nearby;
     for (unsigned k = 0; k < Person::players.size(); k++) {
         if (Dialog::inDialog()) {
             Person::players[k]->attackkeydown = 0;
@@ -2525,7 +2562,14 @@ void doAttacks()
                     if (Person::players[k]->jumppower <= 1) {
                         Person::players[k]->jumppower -= 2;
                     } else {
-                        for (unsigned i = 0; i < Person::players.size(); i++) {
+                        /* Earlier iterations can snap, reverse or knock players
+                         * around, so rebuild right before the scan instead of
+                         * tracking every move; dodges are rare enough that this
+                         * costs less than keeping the grid in sync all loop */
+                        Person::updateGrid();
+                        Person::grid.query(Person::players[k]->coords, sqrtf(6.5), nearby);
+                        for (unsigned n = 0; n < nearby.size(); n++) {
+                            const unsigned i = nearby[n];
                             if (i == k) {
                                 continue;
                             }
@@ -3027,9 +3071,18 @@ void doPlayerCollisions()
     MICROPROFILE_SCOPEI("Game", "doPlayerCollisions", 0xff008f);
     static XYZ rotatetarget;
     static float collisionradius;
+    static std::vector<unsigned> nearby;
     if (Person::players.size() > 1) {
+        Person::updateGrid();
         for (unsigned k = 0; k < Person::players.size(); k++) {
-            for (unsigned i = k + 1; i < Person::players.size(); i++) {
+            // same reach as the bounding box test below
+            XYZ center = Person::players[k]->coords;
+            Person::grid.query(center, 3, nearby);
+            for (unsigned n = 0; n < nearby.size(); n++) {
+                const unsigned i = nearby[n];
+                if (i <= k) {
+                    continue;
+                }
                 //neither player is part of a reversal
                 if ((Animation::animations[Person::players[i]->animTarget].attack != reversed &&
                      Animation::animations[Person::players[i]->animTarget].attack != reversal &&
@@ -3245,6 +3298,7 @@ void doPlayerCollisions()
                         }
                     }
                 }
+                syncPlayerPair(k, i, 3, center, nearby, n);
             }
         }
     }
@@ -3256,6 +3310,15 @@ void Game::Tick()
 
     float mult_start = multiplier;
 
+    // persons and thrown weapons are drawn between here and where this
+    // tick leaves them
+    for (unsigned i = 0; i < Person::players.size(); i++) {
+        Person::players[i]->tickcoords = Person::players[i]->coords;
+    }
+    for (unsigned i = 0; i < weapons.size(); i++) {
+        weapons[i].tickposition = weapons[i].position;
+    }
+
     static XYZ facing, flatfacing;
     static int target;
 
@@ -3767,6 +3830,8 @@ void Game::Tick()
             static bool movekey;
 
 {MICROPROFILE_SCOPEI("Game::Tick", "AI", 0xb500ff);
+            static std::vector<unsigned> nearweapons;
+            weapons.updateGrid();
             //?
             for (unsigned i = 0; i < Person::players.size(); i++) {
                 static float oldtargetyaw;
@@ -3954,7 +4019,9 @@ void Game::Tick()
                              Person::players[i]->animTarget == backhandspringanim ||
                              Person::players[i]->isFlip() ||
                              !Person::players[i]->isPlayerControlled())) {
-                            for (unsigned j = 0; j < weapons.size(); j++) {
+                            weapons.grid.query(Person::players[i]->coords, sqrtf(2), nearweapons);
+                            for (unsigned n = 0; n < nearweapons.size(); n++) {
+                                const unsigned j = nearweapons[n];
                                 if ((weapons[j].velocity.x == 0 && weapons[j].velocity.y == 0 && weapons[j].velocity.z == 0 ||
                                      Person::players[i]->isPlayerControlled()) &&
                                     weapons[j].owner == -1 &&
@@ -4005,7 +4072,10 @@ void Game::Tick()
                                                 Person::players[i]->throwtogglekeydown = 1;
                                                 Person::players[i]->hasvictim = 0;
 
-                                                for (unsigned k = 0; k < weapons.size(); k++) {
+                                                std::vector<unsigned> flipweapons;
+                                                weapons.grid.query(Person::players[i]->coords, sqrtf(3), flipweapons);
+                                                for (unsigned m = 0; m < flipweapons.size(); m++) {
+                                                    const unsigned k = flipweapons[m];
                                                     if (!Person::players[i]->hasWeapon()) {
                                                         if ((weapons[k].velocity.x == 0 && weapons[k].velocity.y == 0 && weapons[k].velocity.z == 0 ||
                                                              Person::players[i]->isPlayerControlled()) &&
@@ -4718,8 +4788,8 @@ void Game::Tick()
             //do animations
             for (unsigned k = 0; k < Person::players.size(); k++) {
                 Person::players[k]->DoAnimations();
-                Person::players[k]->whichpatchx = Person::players[k]->coords.x / (terrain.size / subdivision * terrain.scale);
-                Person::players[k]->whichpatchz = Person::players[k]->coords.z / (terrain.size / subdivision * terrain.scale);
+                Person::players[k]->whichpatchx = Person::players[k]->coords.x / (terrain.size / terrain.subdivision * terrain.scale);
+                Person::players[k]->whichpatchz = Person::players[k]->coords.z / (terrain.size / terrain.subdivision * terrain.scale);
             }
 
             //do stuff
@@ -5199,26 +5269,34 @@ void Game::TickOnceAfter()
             if (cameradist > 2.3) {
                 cameradist = 2.3;
             }
-            viewer = cameraloc - facing * cameradist;
+            // follow the player as drawn, not as last simulated, so the
+            // checks below see where the camera actually ends up
+            XYZ drawoffset;
+            if (!mainmenu) {
+                drawoffset = Person::players[0]->drawOffset();
+            }
+            XYZ drawloc = cameraloc + drawoffset;
+            XYZ drawtarget = target + drawoffset;
+            viewer = drawloc - facing * cameradist;
             colviewer = viewer;
-            coltarget = cameraloc;
+            coltarget = drawloc;
             Object::SphereCheckPossible(&colviewer, findDistance(&colviewer, &coltarget));
             for (unsigned int j = 0; j < terrain.patchobjects[Person::players[0]->whichpatchx][Person::players[0]->whichpatchz].size(); j++) {
-                unsigned int i = terrain.patchobjects[Person::players[0]->whichpatchx][Person::players[0]->whichpatchz][j];
+                unsigned int i = terrain.patchObject(Person::players[0]->whichpatchx, Person::players[0]->whichpatchz, j);
                 colviewer = viewer;
-                coltarget = cameraloc;
+                coltarget = drawloc;
                 if (Object::objects[i]->model.LineCheckPossible(&colviewer, &coltarget, &col, &Object::objects[i]->position, &Object::objects[i]->yaw) != -1) {
                     viewer = col;
                 }
             }
             for (unsigned int j = 0; j < terrain.patchobjects[Person::players[0]->whichpatchx][Person::players[0]->whichpatchz].size(); j++) {
-                unsigned int i = terrain.patchobjects[Person::players[0]->whichpatchx][Person::players[0]->whichpatchz][j];
+                unsigned int i = terrain.patchObject(Person::players[0]->whichpatchx, Person::players[0]->whichpatchz, j);
                 colviewer = viewer;
                 if (Object::objects[i]->model.SphereCheck(&colviewer, .15, &col, &Object::objects[i]->position, &Object::objects[i]->yaw) != -1) {
                     viewer = colviewer;
                 }
             }
-            cameradist = findDistance(&viewer, &target);
+            cameradist = findDistance(&viewer, &drawtarget);
             viewer.y = max((double)viewer.y, terrain.getHeight(viewer.x, viewer.z) + .6);
             float th = terrain.getHeight(cameraloc.x, cameraloc.z);
             if (cameraloc.y < th) {
@@ -31,6 +31,8 @@ float volume = 0;
 bool ismotionblur = false;
 float usermousesensitivity = 0;
 int phys_quality = 1;
+int workerthreads = 0;
+bool pinthreads = false;
 bool floatjump = false;
 bool cellophane = false;
 bool autoslomo = false;
@@ -47,6 +49,7 @@ int difficulty = 0;
 bool did_just_load = false;
 float multiplier = 0;
 float realmultiplier = 0;
+float tickalpha = 1;
 float screenwidth = 0, screenheight = 0;
 #if PLATFORM_VITA
 float minscreenwidth = 960, minscreenheight = 544;
@@ -0,0 +1,231 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Graphic/ClothesCompositor.hpp"
+
+#include "Math/Simd.hpp"
+#include "Thirdparty/microprofile/microprofile.h"
+#include "Utils/Log.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CLOTHES_CACHE_SIZE 8
+
+/* a / 255 and 1 - a / 255 for every alpha, exactly as the scalar blend computes them */
+struct AlphaWeights
+{
+    float weight[256];
+    float remain[256];
+
+    AlphaWeights()
+    {
+        for (int i = 0; i < 256; i++) {
+            float alphanum = i;
+            weight[i] = alphanum / 255;
+            remain[i] = 1 - alphanum / 255;
+        }
+    }
+};
+
+static const AlphaWeights& alphaWeights()
+{
+    static const AlphaWeights weights;
+    return weights;
+}
+
+/* byte-wise blend for anything that isn't RGBA, RGB images are fully opaque */
+static void blendBytes(GLubyte* skin, const GLubyte* image, int bytes, int bytesPerPixel, const float tint[3])
+{
+    int tempnum = 0;
+    float alphanum = 255;
+    for (int i = 0; i < bytes; i++) {
+        uint8_t col = image[i];
+
+        if (bytesPerPixel == 3) {
+            alphanum = 255;
+        } else if ((i + 1) % 4 == 0) {
+            alphanum = col;
+        }
+        if ((i + 1) % 4 || bytesPerPixel == 3) {
+            if ((i % 4) < 3) {
+                col *= tint[i % 4];
+            }
+            skin[tempnum] = (float)skin[tempnum] * (1 - alphanum / 255) + (float)col * (alphanum / 255);
+            tempnum++;
+        }
+    }
+}
+
+/**
+ * RGBA images are blended four pixels at a time, one channel per vector.
+ * Like the original byte loop, each pixel is blended with the alpha of the
+ * pixel before it (the alpha byte is read after the colour bytes).
+ * */
+void ClothesCompositor::blend(GLubyte* skin, const GLubyte* image, int pixels, int bytesPerPixel, const float tint[3])
+{
+    MICROPROFILE_SCOPEI("ClothesCompositor", "blend", 0xaaffaa);
+    if (bytesPerPixel != 4) {
+        blendBytes(skin, image, pixels * bytesPerPixel, bytesPerPixel, tint);
+        return;
+    }
+
+    const AlphaWeights& weights = alphaWeights();
+    int alpha = 255;
+    int p = 0;
+
+#if VEC4_SIMD
+    const vec4 tints[3] = { VEC4_SPLAT(tint[0]), VEC4_SPLAT(tint[1]), VEC4_SPLAT(tint[2]) };
+    float src[3][4], dst[3][4], weight[4], remain[4], res[4];
+    for (; p + 4 <= pixels; p += 4) {
+        for (int l = 0; l < 4; l++) {
+            const GLubyte* in = image + (p + l) * 4;
+            const GLubyte* out = skin + (p + l) * 3;
+            weight[l] = weights.weight[alpha];
+            remain[l] = weights.remain[alpha];
+            for (int c = 0; c < 3; c++) {
+                src[c][l] = in[c];
+                dst[c][l] = out[c];
+            }
+            alpha = in[3];
+        }
+
+        const vec4 w = VEC4_LOAD(weight);
+        const vec4 r = VEC4_LOAD(remain);
+        for (int c = 0; c < 3; c++) {
+            vec4 col = VEC4_TRUNC(VEC4_MUL(VEC4_LOAD(src[c]), tints[c]));
+            VEC4_STORE(res, VEC4_MADD(VEC4_MUL(VEC4_LOAD(dst[c]), r), col, w));
+            for (int l = 0; l < 4; l++) {
+                skin[(p + l) * 3 + c] = res[l];
+            }
+        }
+    }
+#endif
+
+    for (; p < pixels; p++) {
+        const GLubyte* in = image + p * 4;
+        GLubyte* out = skin + p * 3;
+        for (int c = 0; c < 3; c++) {
+            uint8_t col = in[c];
+            col *= tint[c];
+            out[c] = (float)out[c] * weights.remain[alpha] + (float)col * weights.weight[alpha];
+        }
+        alpha = in[3];
+    }
+}
+
+struct ClothesCacheEntry
+{
+    std::string key;
+    std::vector<GLubyte> skin;
+};
+
+static pthread_mutex_t mtxClothesCache = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<ClothesCacheEntry> clothesCache;
+
+std::string ClothesCompositor::cacheKey(const GLubyte* skin, int bytes, const std::vector<std::string>& clothes, const std::vector<float>& tintr, const std::vector<float>& tintg, const std::vector<float>& tintb)
+{
+    // FNV-1a over the skin, it may already be painted with blood
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < bytes; i++) {
+        hash = (hash ^ skin[i]) * 1099511628211ULL;
+    }
+
+    std::string key((const char*)&hash, sizeof(hash));
+    key.append((const char*)&bytes, sizeof(bytes));
+    for (unsigned i = 0; i < clothes.size(); i++) {
+        const float tint[3] = { tintr[i], tintg[i], tintb[i] };
+        key += clothes[i];
+        key.push_back('\0');
+        key.append((const char*)tint, sizeof(tint));
+    }
+    return key;
+}
+
+bool ClothesCompositor::findCached(const std::string& key, GLubyte* skin, int bytes)
+{
+    bool found = false;
+
+    if(pthread_mutex_lock(&mtxClothesCache)){
+        ASSERT(!"Failed to lock clothes cache mutex");
+        return false;
+    }
+
+    for (unsigned i = 0; i < clothesCache.size(); i++) {
+        if (clothesCache[i].key == key && (int)clothesCache[i].skin.size() == bytes) {
+            memcpy(skin, &clothesCache[i].skin[0], bytes);
+            found = true;
+            break;
+        }
+    }
+
+    if(pthread_mutex_unlock(&mtxClothesCache)){
+        ASSERT(!"Failed to unlock clothes cache mutex");
+    }
+    return found;
+}
+
+void ClothesCompositor::addCached(const std::string& key, const GLubyte* skin, int bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+
+    if(pthread_mutex_lock(&mtxClothesCache)){
+        ASSERT(!"Failed to lock clothes cache mutex");
+        return;
+    }
+
+    bool found = false;
+    for (unsigned i = 0; i < clothesCache.size(); i++) {
+        if (clothesCache[i].key == key) {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        if (clothesCache.size() >= CLOTHES_CACHE_SIZE) {
+            clothesCache.erase(clothesCache.begin());
+        }
+        ClothesCacheEntry entry;
+        entry.key = key;
+        entry.skin.assign(skin, skin + bytes);
+        clothesCache.push_back(entry);
+    }
+
+    if(pthread_mutex_unlock(&mtxClothesCache)){
+        ASSERT(!"Failed to unlock clothes cache mutex");
+    }
+}
+
+void ClothesCompositor::clearCache()
+{
+    if(pthread_mutex_lock(&mtxClothesCache)){
+        ASSERT(!"Failed to lock clothes cache mutex");
+        return;
+    }
+
+    clothesCache.clear();
+
+    if(pthread_mutex_unlock(&mtxClothesCache)){
+        ASSERT(!"Failed to unlock clothes cache mutex");
+    }
+}
@@ -0,0 +1,49 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CLOTHESCOMPOSITOR_HPP_
+#define _CLOTHESCOMPOSITOR_HPP_
+
+#include "Graphic/gamegl.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * Blends tinted clothing images into a person's RGB skin texture, and keeps
+ * a few finished skins so persons wearing the same outfit over the same
+ * skin copy the result instead of compositing it again.
+ * */
+class ClothesCompositor
+{
+public:
+    /* blends `pixels` texels of an RGB or RGBA image over the RGB skin */
+    static void blend(GLubyte* skin, const GLubyte* image, int pixels, int bytesPerPixel, const float tint[3]);
+
+    /* identifies the skin as it is now together with the outfit to put on it */
+    static std::string cacheKey(const GLubyte* skin, int bytes, const std::vector<std::string>& clothes, const std::vector<float>& tintr, const std::vector<float>& tintg, const std::vector<float>& tintb);
+
+    /* copies a finished skin into `skin`, returns false if there is none */
+    static bool findCached(const std::string& key, GLubyte* skin, int bytes);
+    static void addCached(const std::string& key, const GLubyte* skin, int bytes);
+    static void clearCache();
+};
+
+#endif
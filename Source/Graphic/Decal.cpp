@@ -41,14 +41,14 @@ Decal::Decal(XYZ _position, decal_type _type, float _opacity, float _rotation, f
     , alivetime(0)
     , brightness(_brightness)
 {
-    if(whichx >= max_terrain_size){
-        whichx = max_terrain_size - 1;
+    if(whichx >= terrain.size){
+        whichx = terrain.size - 1;
     }
     if(whichx < 0){
         whichx = 0;
     }
-    if(whichy + 1 >= max_terrain_size){
-        whichy = max_terrain_size - 2;
+    if(whichy + 1 >= terrain.size){
+        whichy = terrain.size - 2;
     }
     if(whichy < 0){
         whichy = 0;
@@ -93,10 +93,10 @@ Decal::Decal(XYZ _position, decal_type _type, float _opacity, float _rotation, f
     vertex[2].z = placez;
 
     ASSERT(whichx >= 0);
-    ASSERT(whichx < max_terrain_size);
+    ASSERT(whichx < terrain.size);
 
     ASSERT(whichy >= 0);
-    ASSERT(whichy + 1 < max_terrain_size);
+    ASSERT(whichy + 1 < terrain.size);
 
     float hval = terrain.heightmap[whichx][whichy + 1];    
     vertex[2].y = hval * terrain.scale + .01;
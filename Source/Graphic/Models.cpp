@@ -31,7 +31,9 @@ extern "C" {
     #include <math_neon.h>
 }
 
+#include <algorithm>
 #include <pthread.h>
+#include <unordered_map>
 
 extern float multiplier;
 extern float viewdistance;
@@ -50,9 +52,171 @@ static void *alloc_model(size_t size){
     return ret;
 }
 
-#define CALCNORM_JOB_SPLIT_DENOM 4
-#define NORM_VERTS_JOB_SPLIT_DENOM 3
-#define UPDATE_VERT_JOB_SPLIT_DENOM 3
+// jobs per model for each normal phase: one per thread that can run them
+// (the workers and the joining thread), never fewer than the old fixed
+// split. Every job is a dependent of each job of the previous phase, and a
+// skeleton job feeds up to three models, so the first and last phases stay
+// within a third of MAX_DEPENDENTS
+#define CALCNORM_JOB_SPLIT_MIN 4
+#define NORM_VERTS_JOB_SPLIT_MIN 3
+#define UPDATE_VERT_JOB_SPLIT_MIN 3
+#define CALCNORM_JOB_SPLIT_MAX (WorkerThread::MAX_DEPENDENTS / 3)
+#define NORM_VERTS_JOB_SPLIT_MAX 8
+#define UPDATE_VERT_JOB_SPLIT_MAX (WorkerThread::MAX_DEPENDENTS / 3)
+
+static size_t jobSplit(size_t minimum, size_t maximum)
+{
+    size_t threads = WorkerThread::workerCount() + 1;
+    return std::max(minimum, std::min(threads, maximum));
+}
+
+/* boxes are grown a little so triangles lying flat on an axis plane and
+ * PointInTriangle's tolerance don't get culled */
+#define BVH_PADDING 0.0001f
+
+/* scratch list for the collision checks, these can run on worker threads */
+static thread_local std::vector<unsigned> bvhCandidates;
+
+void Model::getTriangleBounds(std::vector<AABB>& out) const
+{
+    out.resize(Triangles.size());
+    for (unsigned int i = 0; i < Triangles.size(); i++) {
+        out[i].reset();
+        out[i].expand(vertex[Triangles[i].vertex[0]]);
+        out[i].expand(vertex[Triangles[i].vertex[1]]);
+        out[i].expand(vertex[Triangles[i].vertex[2]]);
+        out[i].pad(BVH_PADDING);
+    }
+}
+
+void Model::buildBVH()
+{
+    MICROPROFILE_SCOPEI("Model", "buildBVH", 0x008fff);
+    std::vector<AABB> bounds;
+    getTriangleBounds(bounds);
+    bvh.build(bounds);
+    bvhValid = true;
+}
+
+void Model::refitBVH()
+{
+    MICROPROFILE_SCOPEI("Model", "refitBVH", 0x008fff);
+    if (bvh.size() != Triangles.size()) {
+        buildBVH();
+        return;
+    }
+    std::vector<AABB> bounds;
+    getTriangleBounds(bounds);
+    bvh.refit(bounds);
+    bvhValid = true;
+}
+
+void Model::buildAdjacency()
+{
+    vertexCornerFirst.assign(vertexNum + 1, 0);
+    for (unsigned int i = 0; i < Triangles.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            vertexCornerFirst[Triangles[i].vertex[j] + 1]++;
+        }
+    }
+    for (int i = 0; i < vertexNum; i++) {
+        vertexCornerFirst[i + 1] += vertexCornerFirst[i];
+    }
+
+    // filled in triangle order so the normal sums match CalculateNormals
+    std::vector<int> fill(vertexCornerFirst.begin(), vertexCornerFirst.end() - 1);
+    vertexCorners.resize(Triangles.size() * 3);
+    for (unsigned int i = 0; i < Triangles.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            vertexCorners[fill[Triangles[i].vertex[j]]++] = i * 3 + j;
+        }
+    }
+}
+
+/* sets the normal of every vertex array corner that uses vertex `which` */
+void Model::setVertexArrayNormal(int which, const XYZ& normal)
+{
+    makeUnique();
+    ASSERT(which >= 0 && which + 1 < (int)vertexCornerFirst.size());
+    for (int k = vertexCornerFirst[which]; k < vertexCornerFirst[which + 1]; k++) {
+        GLfloat* corner = &vArray[vertexCorners[k] * 8];
+        corner[2] = normal.x;
+        corner[3] = normal.y;
+        corner[4] = normal.z;
+    }
+}
+
+/**
+ * Ritter's bounding sphere: start from two far apart vertices, then grow
+ * the sphere just enough to take in every vertex left outside it
+ * */
+void Model::computeBoundingSphere()
+{
+    boundingspherecenter = 0;
+    boundingsphereradius = 0;
+    if (vertexNum <= 0) {
+        return;
+    }
+
+    int a = 0;
+    for (int i = 1; i < vertexNum; i++) {
+        if (distsq(&vertex[i], &vertex[0]) > distsq(&vertex[a], &vertex[0])) {
+            a = i;
+        }
+    }
+    int b = a;
+    for (int i = 0; i < vertexNum; i++) {
+        if (distsq(&vertex[i], &vertex[a]) > distsq(&vertex[b], &vertex[a])) {
+            b = i;
+        }
+    }
+
+    XYZ center = (vertex[a] + vertex[b]) / 2;
+    float radius = fast_sqrt(distsq(&vertex[a], &vertex[b])) / 2;
+    float radiussq = radius * radius;
+    for (int i = 0; i < vertexNum; i++) {
+        float dsq = distsq(&vertex[i], &center);
+        if (dsq > radiussq) {
+            float dist = fast_sqrt(dsq);
+            float newradius = (radius + dist) / 2;
+            center += (vertex[i] - center) * ((newradius - radius) / dist);
+            radius = newradius;
+            radiussq = radius * radius;
+        }
+    }
+
+    boundingspherecenter = center;
+    boundingsphereradius = radius;
+}
+
+void Model::invalidateBVH()
+{
+    bvhValid = false;
+}
+
+void Model::queryTriangles(const AABB& box, std::vector<unsigned>& out) const
+{
+    if (bvhValid) {
+        triangleTree().queryBox(box, out);
+        return;
+    }
+    out.resize(Triangles.size());
+    for (unsigned int i = 0; i < out.size(); i++) {
+        out[i] = i;
+    }
+}
+
+void Model::queryTriangles(const XYZ& start, const XYZ& end, std::vector<unsigned>& out) const
+{
+    if (bvhValid) {
+        triangleTree().querySegment(start, end, out);
+        return;
+    }
+    out.resize(Triangles.size());
+    for (unsigned int i = 0; i < out.size(); i++) {
+        out[i] = i;
+    }
+}
 
 
 /**
@@ -82,7 +246,11 @@ int Model::LineCheck(XYZ* p1, XYZ* p2, XYZ* p, XYZ* move, float* rotate)
     }
     firstintersecting = -1;
 
-    for (unsigned int j = 0; j < Triangles.size(); j++) {
+    std::vector<unsigned>& candidates = bvhCandidates;
+    queryTriangles(*p1, *p2, candidates);
+
+    for (unsigned int c = 0; c < candidates.size(); c++) {
+        const unsigned int j = candidates[c];
         intersecting = LineFacetd(p1, p2, &vertex[Triangles[j].vertex[0]], &vertex[Triangles[j].vertex[1]], &vertex[Triangles[j].vertex[2]], &Triangles[j].facenormal, &point);
         distance = (point.x - p1->x) * (point.x - p1->x) + (point.y - p1->y) * (point.y - p1->y) + (point.z - p1->z) * (point.z - p1->z);
         if ((distance < olddistance || firstintersecting == -1) && intersecting) {
@@ -207,8 +375,12 @@ int Model::SphereCheck(XYZ* p1, float radius, XYZ* p, XYZ* move, float* rotate)
         return -1;
     }
 
+    std::vector<unsigned>& candidates = bvhCandidates;
+
     for (i = 0; i < 4; i++) {
-        for (unsigned int j = 0; j < Triangles.size(); j++) {
+        queryTriangles(AABB::fromSphere(*p1, radius), candidates);
+        for (unsigned int c = 0; c < candidates.size(); c++) {
+            const unsigned int j = candidates[c];
             intersecting = 0;
             distance = abs((Triangles[j].facenormal.x * p1->x) + (Triangles[j].facenormal.y * p1->y) + (Triangles[j].facenormal.z * p1->z) - ((Triangles[j].facenormal.x * vertex[Triangles[j].vertex[0]].x) + (Triangles[j].facenormal.y * vertex[Triangles[j].vertex[0]].y) + (Triangles[j].facenormal.z * vertex[Triangles[j].vertex[0]].z)));
             if (distance < radius) {
@@ -227,6 +399,10 @@ int Model::SphereCheck(XYZ* p1, float radius, XYZ* p, XYZ* move, float* rotate)
                 }
                 if (intersecting) {
                     *p1 += Triangles[j].facenormal * (distance - radius);
+
+                    // the sphere moved, carry on with what it touches now
+                    queryTriangles(AABB::fromSphere(*p1, radius), candidates);
+                    c = std::upper_bound(candidates.begin(), candidates.end(), j) - candidates.begin() - 1;
                 }
             }
             if ((distance < olddistance || firstintersecting == -1) && intersecting) {
@@ -272,7 +448,11 @@ int Model::SphereCheckPossible(XYZ* p1, float radius, XYZ* move, float* rotate)
         return -1;
     }
 
-    for (unsigned int j = 0; j < Triangles.size(); j++) {
+    std::vector<unsigned>& candidates = bvhCandidates;
+    queryTriangles(AABB::fromSphere(*p1, radius), candidates);
+
+    for (unsigned int c = 0; c < candidates.size(); c++) {
+        const unsigned int j = candidates[c];
         intersecting = 0;
         distance = abs((Triangles[j].facenormal.x * p1->x) + (Triangles[j].facenormal.y * p1->y) + (Triangles[j].facenormal.z * p1->z) - ((Triangles[j].facenormal.x * vertex[Triangles[j].vertex[0]].x) + (Triangles[j].facenormal.y * vertex[Triangles[j].vertex[0]].y) + (Triangles[j].facenormal.z * vertex[Triangles[j].vertex[0]].z)));
         if (distance < radius) {
@@ -312,6 +492,7 @@ void Model::UpdateVertexArray()
     if (type != normaltype && type != decalstype) {
         return;
     }
+    makeUnique();
 
     if (flat) {
         for (unsigned int i = 0; i < Triangles.size(); i++) {
@@ -382,6 +563,7 @@ void Model::UpdateVertexArrayNoTex()
     if (type != normaltype && type != decalstype) {
         return;
     }
+    makeUnique();
 
     if (flat) {
         for (unsigned int i = 0; i < Triangles.size(); i++) {
@@ -441,6 +623,7 @@ void Model::UpdateVertexArrayNoTexNoNorm()
     if (type != normaltype && type != decalstype) {
         return;
     }
+    makeUnique();
 
     for (unsigned int i = 0; i < Triangles.size(); i++) {
         unsigned int j = i * 24;
@@ -521,8 +704,15 @@ struct ModelCacheEntry {
     }
 };
 
+/* models sharing cached geometry use its tree until makeUnique copies it */
+const AABBTree& Model::triangleTree() const
+{
+    return sharedGeometry != nullptr ? sharedGeometry->model->bvh : bvh;
+}
+
 static pthread_mutex_t mtxCache;
-std::vector<std::shared_ptr<ModelCacheEntry>> modelCache;
+/* keyed by load variant and path, see modelCacheKey */
+static std::unordered_map<std::string, std::shared_ptr<ModelCacheEntry>> modelCache;
 static bool did_init_once = false;
 void Model::initModelCache(){
     ASSERT(modelCache.size() == 0);
@@ -535,38 +725,41 @@ void Model::initModelCache(){
 }
 
 void Model::clearModelCache(){
+    //models still sharing geometry keep their entry alive
     modelCache.clear();
 }
 
-static bool getModelCache(Model *model, const std::string &filename){
+static std::string modelCacheKey(ModelType type, const std::string &filename){
+    return std::to_string((int)type) + ":" + filename;
+}
+
+static bool getModelCache(Model *model, const std::string &filename, std::shared_ptr<const ModelCacheEntry> &out){
+    const std::string key = modelCacheKey(model->type, filename);
+
     if(pthread_mutex_lock(&mtxCache)){
         ASSERT(!"Failed to lock model cache mutex");
         return false;
     }
 
     std::shared_ptr<ModelCacheEntry> cached = nullptr;
-    for(std::shared_ptr<ModelCacheEntry> cache: modelCache){
-        if(cache->model->type == model->type){
-            if(cache->filename == filename){
-                cached = cache;
-                break;
-            }
-        }
+    auto found = modelCache.find(key);
+    if(found != modelCache.end()){
+        cached = found->second;
     }
 
-    if(cached == nullptr){
-        if(pthread_mutex_unlock(&mtxCache)){
-            ASSERT(!"Failed to unlock model cache mutex");
-            return false;
-        }
+    if(pthread_mutex_unlock(&mtxCache)){
+        ASSERT(!"Failed to unlock model cache mutex");
+        return false;
+    }
 
+    if(cached == nullptr){
         Model *cm = new Model();
         bool ok = false;
 
         switch(model->type){
             default:
                 ASSERT(!"Bad model type");
-                pthread_mutex_unlock(&mtxCache);
+                delete cm;
                 return false;
         
             case notextype:
@@ -585,61 +778,279 @@ static bool getModelCache(Model *model, const std::string &filename){
                 ok = cm->load(filename, false);
                 break;
         }
-        
+
+        if(!ok){
+            delete cm;
+            return false;
+        }
+
+#ifdef DRAW_SPEEDHACK
+        //models sharing this one draw straight from its vertex array
+        if(cm->vArray != nullptr && !cm->Triangles.empty()){
+            size_t size = sizeof(GLfloat) * cm->Triangles.size() * 24;
+            GLfloat *mapped = (GLfloat*)alloc_model(size);
+            memcpy(mapped, cm->vArray, size);
+            free(cm->vArray);
+            cm->vArray = mapped;
+            cm->vgl_array = true;
+        }
+#endif
+
         if(pthread_mutex_lock(&mtxCache)){
             ASSERT(!"Failed to lock model cache mutex");
             return false;
         }
 
-        if(ok){
-            modelCache.push_back(std::make_shared<ModelCacheEntry>(filename, cm));
-            cached = modelCache.back();
-        }else{
-            delete cm;
-            cached = nullptr;
+        //if another thread loaded the same model meanwhile, use theirs
+        auto ins = modelCache.emplace(key, std::make_shared<ModelCacheEntry>(filename, cm));
+        cached = ins.first->second;
+
+        if(pthread_mutex_unlock(&mtxCache)){
+            ASSERT(!"Failed to unlock model cache mutex");
+            return false;
         }
     }
-    
-    if(pthread_mutex_unlock(&mtxCache)){
-        ASSERT(!"Failed to unlock model cache mutex");
+
+    out = cached;
+    return true;
+}
+
+TriangleList::TriangleList()
+    : data(nullptr)
+    , count(0)
+{
+    //--
+}
+
+void TriangleList::resize(unsigned n)
+{
+    storage.resize(n);
+    data = storage.empty() ? nullptr : &storage[0];
+    count = n;
+}
+
+void TriangleList::share(const TriangleList& other)
+{
+    storage.clear();
+    data = other.data;
+    count = other.count;
+}
+
+void TriangleList::copy(const TriangleList& other)
+{
+    storage.assign(other.data, other.data + other.count);
+    data = storage.empty() ? nullptr : &storage[0];
+    count = other.count;
+}
+
+void TriangleList::clear()
+{
+    storage.clear();
+    data = nullptr;
+    count = 0;
+}
+
+/**
+ * Points this model's geometry, vertex array, collision tree and adjacency
+ * at the cached copy of `filename` instead of building its own, see
+ * makeUnique
+ * */
+bool Model::shareCachedGeometry(const std::string& filename)
+{
+    ASSERT(vertex == nullptr);
+    ASSERT(normals == nullptr);
+    ASSERT(Triangles.size() == 0);
+
+    std::shared_ptr<const ModelCacheEntry> cached;
+    if(!getModelCache(this, filename, cached)){
         return false;
     }
 
-    if(cached == nullptr){
+    const Model *cm = cached->model;
+    sharedGeometry = cached;
+    vertexNum = cm->vertexNum;
+    vertex = cm->vertex;
+    normals = cm->normals;
+    vArray = cm->vArray;
+    Triangles.share(cm->Triangles);
+    boundingspherecenter = cm->boundingspherecenter;
+    boundingsphereradius = cm->boundingsphereradius;
+    bvhValid = cm->bvhValid;
+    return true;
+}
+
+void Model::makeUnique()
+{
+    if(sharedGeometry == nullptr){
+        return;
+    }
+    MICROPROFILE_SCOPEI("Model", "makeUnique", 0x008fff);
+
+    const Model *cm = sharedGeometry->model;
+    vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
+    ASSERT(vertex != nullptr);
+    memcpy(vertex, cm->vertex, sizeof(XYZ) * vertexNum);
+
+    if(cm->normals != nullptr){
+        normals = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
+        ASSERT(normals != nullptr);
+        memcpy(normals, cm->normals, sizeof(XYZ) * vertexNum);
+    }
+
+    Triangles.copy(cm->Triangles);
+
+    if(cm->vArray != nullptr){
+        size_t size = sizeof(GLfloat) * Triangles.size() * 24;
+        vArray = (GLfloat*)alloc_model(size);
+        memcpy(vArray, cm->vArray, size);
+        vgl_array = true;
+    }
+
+    bvh = cm->bvh;
+    vertexCornerFirst = cm->vertexCornerFirst;
+    vertexCorners = cm->vertexCorners;
+    sharedGeometry = nullptr;
+}
+
+/* Cooked meshes (see asset_proc/cook_model.py) start with this header
+ * instead of the big endian .solid counts. Everything is little endian and
+ * the vertex block has the same layout as Model::vertex, so both blocks are
+ * read with a single call each. */
+#define COOKED_MODEL_MAGIC "LMDL"
+#define COOKED_MODEL_VERSION 1
+
+struct CookedModelHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexNum;
+    uint32_t triangleNum;
+    uint32_t vertexOffset;   // XYZ[vertexNum]
+    uint32_t triangleOffset; // CookedTriangle[triangleNum]
+    uint32_t reserved[2];
+};
+
+struct CookedTriangle {
+    uint16_t vertex[3];
+    uint16_t pad;
+    float gx[3];
+    float gy[3];
+};
+
+static_assert(sizeof(CookedModelHeader) == 32, "cooked model header layout changed");
+static_assert(sizeof(CookedTriangle) == 32, "cooked triangle layout changed");
+static_assert(sizeof(XYZ) == 12, "cooked vertices are read straight into XYZ");
+
+bool Model::readCooked(PHYSFS_File* tfile, const CookedModelHeader& header, bool withNormals)
+{
+    MICROPROFILE_SCOPEI("Model", "readCooked", 0x008fff);
+    if (header.version != COOKED_MODEL_VERSION) {
+        LOG("Unsupported cooked model version %u", (unsigned)header.version);
+        return false;
+    }
+    if (header.vertexNum > 0x7fff || header.triangleNum > 0x7fff) {
+        LOG("Cooked model is too large (%u vertices, %u triangles)", (unsigned)header.vertexNum, (unsigned)header.triangleNum);
         return false;
     }
 
-    ASSERT(model->vertex == nullptr);
-    ASSERT(model->normals == nullptr);
-    ASSERT(model->Triangles.size() == 0);
-    ASSERT(model->vertexNum == 0);
+    vertexNum = header.vertexNum;
+    vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
+    if (withNormals) {
+        normals = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
+    }
+    Triangles.resize(header.triangleNum);
+
+    PHYSFS_sint64 vsize = sizeof(XYZ) * vertexNum;
+    if (!PHYSFS_seek(tfile, header.vertexOffset) || PHYSFS_readBytes(tfile, vertex, vsize) != vsize) {
+        LOG("Failed to read cooked model vertices");
+        return false;
+    }
 
-    int numVert = cached->model->vertexNum;
-    model->vertexNum = numVert;
-    model->vertex = (XYZ*)malloc(sizeof(XYZ) * numVert);
-    ASSERT(model->vertex != nullptr);
+    std::vector<CookedTriangle> tris(header.triangleNum);
+    PHYSFS_sint64 tsize = sizeof(CookedTriangle) * tris.size();
+    if (tsize > 0 && (!PHYSFS_seek(tfile, header.triangleOffset) || PHYSFS_readBytes(tfile, &tris[0], tsize) != tsize)) {
+        LOG("Failed to read cooked model triangles");
+        return false;
+    }
 
-    memcpy(model->vertex, cached->model->vertex, sizeof(XYZ) * numVert);
-    
-    if(cached->model->type == decalstype || cached->model->type == normaltype){
-        model->normals = (XYZ*)malloc(sizeof(XYZ) * numVert);
-        memcpy(model->normals, cached->model->normals, sizeof(XYZ) * numVert);
+    for (unsigned i = 0; i < tris.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            if (tris[i].vertex[j] >= (unsigned)vertexNum) {
+                LOG("Cooked model triangle %u has a bad vertex index", i);
+                return false;
+            }
+            Triangles[i].vertex[j] = tris[i].vertex[j];
+            Triangles[i].gx[j] = tris[i].gx[j];
+            Triangles[i].gy[j] = tris[i].gy[j];
+        }
+    }
+    return true;
+}
+
+bool Model::readSolid(PHYSFS_File* tfile, bool withNormals)
+{
+    MICROPROFILE_SCOPEI("Model", "readSolid", 0x008fff);
+    long i;
+    short triangleNum;
+
+    // read model settings
+    funpackf(tfile, "Bs Bs", &vertexNum, &triangleNum);
+
+    // read the model data
+    vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
+    if (withNormals) {
+        normals = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
     }
+    Triangles.resize(triangleNum);
 
-    model->Triangles = cached->model->Triangles;
+    for (i = 0; i < vertexNum; i++) {
+        funpackf(tfile, "Bf Bf Bf", &vertex[i].x, &vertex[i].y, &vertex[i].z);
+    }
 
-    ASSERT(model->vertexNum == cached->model->vertexNum);
-    ASSERT(model->Triangles.size() == cached->model->Triangles.size());
-    ASSERT(&model->Triangles[0] != &cached->model->Triangles[0]);
+    for (i = 0; i < triangleNum; i++) {
+        short vertex[6];
+        funpackf(tfile, "Bs Bs Bs Bs Bs Bs", &vertex[0], &vertex[1], &vertex[2], &vertex[3], &vertex[4], &vertex[5]);
+        Triangles[i].vertex[0] = vertex[0];
+        Triangles[i].vertex[1] = vertex[2];
+        Triangles[i].vertex[2] = vertex[4];
+        funpackf(tfile, "Bf Bf Bf", &Triangles[i].gx[0], &Triangles[i].gx[1], &Triangles[i].gx[2]);
+        funpackf(tfile, "Bf Bf Bf", &Triangles[i].gy[0], &Triangles[i].gy[1], &Triangles[i].gy[2]);
+    }
     return true;
 }
 
+/**
+ * Reads vertices and triangles from either a cooked mesh or a .solid file,
+ * allocating vertex (and normals if asked to) and sizing Triangles
+ * */
+bool Model::readMesh(const std::string& filename, bool withNormals)
+{
+    PHYSFS_File* tfile = PHYSFS_openRead(Folders::getResourcePath(filename).c_str());
+    if (tfile == NULL) {
+        auto ec = PHYSFS_getLastErrorCode();
+        LOG("Failed to open model %s. Error Code: %d, Msg: %s", filename.c_str(), (int)ec, PHYSFS_getErrorByCode(ec));
+        return false;
+    }
+
+    bool ok;
+    CookedModelHeader header;
+    if (PHYSFS_readBytes(tfile, &header, sizeof(header)) == sizeof(header) && memcmp(header.magic, COOKED_MODEL_MAGIC, 4) == 0) {
+        ok = readCooked(tfile, header, withNormals);
+    } else {
+        PHYSFS_seek(tfile, 0);
+        ok = readSolid(tfile, withNormals);
+    }
+    PHYSFS_close(tfile);
+
+    if (!ok) {
+        LOG("Failed to read model %s", filename.c_str());
+    }
+    return ok;
+}
+
 bool Model::loadnotex(const std::string& filename, bool use_cache)
 {
     MICROPROFILE_SCOPEI("Model", "loadnotex", 0x008fff);
-    PHYSFS_File* tfile;
     long i;
-    short triangleNum;
 
     type = notextype;
     color = 0;
@@ -648,67 +1059,37 @@ bool Model::loadnotex(const std::string& filename, bool use_cache)
     possible.clear();
 
     if(use_cache){
-        if(!getModelCache(this, filename)){
+        if(!shareCachedGeometry(filename)){
             ASSERT(!"Failed to load notex model!");
             return false;
         }
         
         owner = (int*)malloc(sizeof(int) * vertexNum);
-        //vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
-        vArray = (GLfloat*)alloc_model(sizeof(GLfloat) * Triangles.size() * 24);
-        vgl_array = true;
     }else{
         vgl_array = false;
-        tfile = PHYSFS_openRead(Folders::getResourcePath(filename).c_str());
-        // read model settings
-        funpackf(tfile, "Bs Bs", &vertexNum, &triangleNum);
-        // read the model data
-        owner = (int*)malloc(sizeof(int) * vertexNum);
-        vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-        Triangles.resize(triangleNum);
-        vArray = (GLfloat*)malloc(sizeof(GLfloat) * triangleNum * 24);
-
-        for (i = 0; i < vertexNum; i++) {
-            funpackf(tfile, "Bf Bf Bf", &vertex[i].x, &vertex[i].y, &vertex[i].z);
-        }
-
-        for (i = 0; i < triangleNum; i++) {
-            short vertex[6];
-            funpackf(tfile, "Bs Bs Bs Bs Bs Bs", &vertex[0], &vertex[1], &vertex[2], &vertex[3], &vertex[4], &vertex[5]);
-            Triangles[i].vertex[0] = vertex[0];
-            Triangles[i].vertex[1] = vertex[2];
-            Triangles[i].vertex[2] = vertex[4];
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gx[0], &Triangles[i].gx[1], &Triangles[i].gx[2]);
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gy[0], &Triangles[i].gy[1], &Triangles[i].gy[2]);
+        if (!readMesh(filename, false)) {
+            ASSERT(!"Failed to load notex model!");
+            return false;
         }
-        PHYSFS_close(tfile);
+        owner = (int*)malloc(sizeof(int) * vertexNum);
+        vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
+        UpdateVertexArray();
+        computeBoundingSphere();
+        buildBVH();
+        buildAdjacency();
     }
-    UpdateVertexArray();
 
     for (i = 0; i < vertexNum; i++) {
         owner[i] = -1;
     }
 
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (int j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
-
     return true;
 }
 
 bool Model::load(const std::string& filename, bool use_cache)
 {
     MICROPROFILE_SCOPEI("Model", "load", 0x008fff);
-    PHYSFS_File* tfile;
     long i;
-    short triangleNum;
 
     LOGFUNC;
 
@@ -723,80 +1104,38 @@ bool Model::load(const std::string& filename, bool use_cache)
     possible.clear();
 
     if(use_cache){
-        if(!getModelCache(this, filename)){
+        if(!shareCachedGeometry(filename)){
             ASSERT(!"Failed to load normal model!");
             return false;
         }
 
         owner = (int*)malloc(sizeof(int) * vertexNum);
-        //vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
-        vArray = (GLfloat*)alloc_model(sizeof(GLfloat) * Triangles.size() * 24);
-        vgl_array = true;
     }else{
         vgl_array = false;
-        tfile = PHYSFS_openRead(Folders::getResourcePath(filename).c_str());
-
-        // read model settings
-        funpackf(tfile, "Bs Bs", &vertexNum, &triangleNum);
-
-        {
-            MICROPROFILE_SCOPEI("Model", "allocbufs", 0x008fff);
-            owner = (int*)malloc(sizeof(int) * vertexNum);
-            vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-            normals = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-            Triangles.resize(triangleNum);
-            vArray = (GLfloat*)malloc(sizeof(GLfloat) * triangleNum * 24);
-        }
-        {
-            MICROPROFILE_SCOPEI("Model", "unpackverts", 0x008fff);
-            for (i = 0; i < vertexNum; i++) {
-                funpackf(tfile, "Bf Bf Bf", &vertex[i].x, &vertex[i].y, &vertex[i].z);
-            }
-        }
-        {
-            MICROPROFILE_SCOPEI("Model", "unpacktris", 0x008fff);
-            for (i = 0; i < triangleNum; i++) {
-                short vertex[6];
-                funpackf(tfile, "Bs Bs Bs Bs Bs Bs", &vertex[0], &vertex[1], &vertex[2], &vertex[3], &vertex[4], &vertex[5]);
-                Triangles[i].vertex[0] = vertex[0];
-                Triangles[i].vertex[1] = vertex[2];
-                Triangles[i].vertex[2] = vertex[4];
-
-                funpackf(tfile, "Bf Bf Bf", &Triangles[i].gx[0], &Triangles[i].gx[1], &Triangles[i].gx[2]);
-                funpackf(tfile, "Bf Bf Bf", &Triangles[i].gy[0], &Triangles[i].gy[1], &Triangles[i].gy[2]);
-            }
+        if (!readMesh(filename, true)) {
+            ASSERT(!"Failed to load normal model!");
+            return false;
         }
-        PHYSFS_close(tfile);
+        owner = (int*)malloc(sizeof(int) * vertexNum);
+        vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
+        UpdateVertexArray();
+        computeBoundingSphere();
+        buildBVH();
+        buildAdjacency();
     }
     modelTexture.xsz = 0;
 
-    UpdateVertexArray();
-
     for (i = 0; i < vertexNum; i++) {
         owner[i] = -1;
     }
 
-    int j;
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
-
     return true;
 }
 
 bool Model::loaddecal(const std::string& filename, bool use_cache)
 {
     MICROPROFILE_SCOPEI("Model", "loaddecal", 0x008fff);
-    PHYSFS_File* tfile;
-    long i, j;
-    short triangleNum;
+    long i;
 
     LOGFUNC;
 
@@ -809,70 +1148,38 @@ bool Model::loaddecal(const std::string& filename, bool use_cache)
     possible.clear();
 
     if(use_cache){
-        if(!getModelCache(this, filename)){
+        if(!shareCachedGeometry(filename)){
             ASSERT(!"Failed to load normal model!");
             return false;
         }
 
         owner = (int*)malloc(sizeof(int) * vertexNum);
-        //vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
-        vArray = (GLfloat*)alloc_model(sizeof(GLfloat) * Triangles.size() * 24);
-        vgl_array = true;
     }else{
         vgl_array = false;
-        tfile = PHYSFS_openRead(Folders::getResourcePath(filename).c_str());
-        // read model settings
-        funpackf(tfile, "Bs Bs", &vertexNum, &triangleNum);
-        // read the model data
-        owner = (int*)malloc(sizeof(int) * vertexNum);
-        vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-        normals = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-        Triangles.resize(triangleNum);
-        vArray = (GLfloat*)malloc(sizeof(GLfloat) * triangleNum * 24);
-
-        for (i = 0; i < vertexNum; i++) {
-            funpackf(tfile, "Bf Bf Bf", &vertex[i].x, &vertex[i].y, &vertex[i].z);
-        }
-
-        for (i = 0; i < triangleNum; i++) {
-            short vertex[6];
-            funpackf(tfile, "Bs Bs Bs Bs Bs Bs", &vertex[0], &vertex[1], &vertex[2], &vertex[3], &vertex[4], &vertex[5]);
-            Triangles[i].vertex[0] = vertex[0];
-            Triangles[i].vertex[1] = vertex[2];
-            Triangles[i].vertex[2] = vertex[4];
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gx[0], &Triangles[i].gx[1], &Triangles[i].gx[2]);
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gy[0], &Triangles[i].gy[1], &Triangles[i].gy[2]);
+        if (!readMesh(filename, true)) {
+            ASSERT(!"Failed to load decal model!");
+            return false;
         }
-        PHYSFS_close(tfile);
+        owner = (int*)malloc(sizeof(int) * vertexNum);
+        vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
+        UpdateVertexArray();
+        computeBoundingSphere();
+        buildBVH();
+        buildAdjacency();
     }
     modelTexture.xsz = 0;
 
-    UpdateVertexArray();
-
     for (i = 0; i < vertexNum; i++) {
         owner[i] = -1;
     }
 
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
-
     return true;
 }
 
 bool Model::loadraw(const std::string& filename, bool use_cache)
 {
     MICROPROFILE_SCOPEI("Model", "loadraw", 0x008fff);
-    PHYSFS_File* tfile;
     long i;
-    short triangleNum;
 
     LOGFUNC;
 
@@ -885,41 +1192,21 @@ bool Model::loadraw(const std::string& filename, bool use_cache)
     possible.clear();
 
     if(use_cache){
-        if(!getModelCache(this, filename)){
+        if(!shareCachedGeometry(filename)){
             ASSERT(!"Failed to load normal model!");
             return false;
         }
         owner = (int*)malloc(sizeof(int) * vertexNum);
-        //vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
-        vArray = (GLfloat*)alloc_model(sizeof(GLfloat) * Triangles.size() * 24);
-        vgl_array = true;
     }else{
         vgl_array = false;
-        tfile = PHYSFS_openRead(Folders::getResourcePath(filename).c_str());
-
-        // read model settings
-        funpackf(tfile, "Bs Bs", &vertexNum, &triangleNum);
-
-        owner = (int*)malloc(sizeof(int) * vertexNum);
-        vertex = (XYZ*)malloc(sizeof(XYZ) * vertexNum);
-        Triangles.resize(triangleNum);
-        vArray = (GLfloat*)malloc(sizeof(GLfloat) * triangleNum * 24);
-
-        for (i = 0; i < vertexNum; i++) {
-            funpackf(tfile, "Bf Bf Bf", &vertex[i].x, &vertex[i].y, &vertex[i].z);
-        }
-
-        for (i = 0; i < triangleNum; i++) {
-            short vertex[6];
-            funpackf(tfile, "Bs Bs Bs Bs Bs Bs", &vertex[0], &vertex[1], &vertex[2], &vertex[3], &vertex[4], &vertex[5]);
-            Triangles[i].vertex[0] = vertex[0];
-            Triangles[i].vertex[1] = vertex[2];
-            Triangles[i].vertex[2] = vertex[4];
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gx[0], &Triangles[i].gx[1], &Triangles[i].gx[2]);
-            funpackf(tfile, "Bf Bf Bf", &Triangles[i].gy[0], &Triangles[i].gy[1], &Triangles[i].gy[2]);
+        if (!readMesh(filename, false)) {
+            ASSERT(!"Failed to load raw model!");
+            return false;
         }
-
-        PHYSFS_close(tfile);
+        owner = (int*)malloc(sizeof(int) * vertexNum);
+        vArray = (GLfloat*)malloc(sizeof(GLfloat) * Triangles.size() * 24);
+        buildBVH();
+        buildAdjacency();
     }
 
     for (i = 0; i < vertexNum; i++) {
@@ -932,6 +1219,7 @@ bool Model::loadraw(const std::string& filename, bool use_cache)
 void Model::UniformTexCoords()
 {
     MICROPROFILE_SCOPEI("Model", "UniformTexCoords", 0x008fff);
+    makeUnique();
     for (unsigned int i = 0; i < Triangles.size(); i++) {
         Triangles[i].gy[0] = vertex[Triangles[i].vertex[0]].y;
         Triangles[i].gy[1] = vertex[Triangles[i].vertex[1]].y;
@@ -946,6 +1234,7 @@ void Model::UniformTexCoords()
 void Model::FlipTexCoords()
 {
     MICROPROFILE_SCOPEI("Model", "FlipTexCoords", 0x008fff);
+    makeUnique();
     for (unsigned int i = 0; i < Triangles.size(); i++) {
         Triangles[i].gy[0] = -Triangles[i].gy[0];
         Triangles[i].gy[1] = -Triangles[i].gy[1];
@@ -957,6 +1246,7 @@ void Model::FlipTexCoords()
 void Model::ScaleTexCoords(float howmuch)
 {
     MICROPROFILE_SCOPEI("Model", "ScaleTexCoords", 0x008fff);
+    makeUnique();
     for (unsigned int i = 0; i < Triangles.size(); i++) {
         Triangles[i].gx[0] *= howmuch;
         Triangles[i].gx[1] *= howmuch;
@@ -971,6 +1261,7 @@ void Model::ScaleTexCoords(float howmuch)
 void Model::Scale(float xscale, float yscale, float zscale)
 {
     MICROPROFILE_SCOPEI("Model", "Scale", 0x008fff);
+    makeUnique();
     int i;
     for (i = 0; i < vertexNum; i++) {
         vertex[i].x *= xscale;
@@ -979,18 +1270,13 @@ void Model::Scale(float xscale, float yscale, float zscale)
     }
     UpdateVertexArray();
 
-    int j;
+    // exact for uniform scales, conservative otherwise
+    boundingspherecenter.x *= xscale;
+    boundingspherecenter.y *= yscale;
+    boundingspherecenter.z *= zscale;
+    boundingsphereradius *= std::max(fabsf(xscale), std::max(fabsf(yscale), fabsf(zscale)));
 
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
+    refitBVH();
 }
 
 void Model::ScaleNormals(float xscale, float yscale, float zscale)
@@ -999,6 +1285,7 @@ void Model::ScaleNormals(float xscale, float yscale, float zscale)
     if (type != normaltype && type != decalstype) {
         return;
     }
+    makeUnique();
 
     for (int i = 0; i < vertexNum; i++) {
         normals[i].x *= xscale;
@@ -1016,6 +1303,7 @@ void Model::ScaleNormals(float xscale, float yscale, float zscale)
 void Model::Translate(float xtrans, float ytrans, float ztrans)
 {
     MICROPROFILE_SCOPEI("Model", "Translate", 0x008fff);
+    makeUnique();
     int i;
     for (i = 0; i < vertexNum; i++) {
         vertex[i].x += xtrans;
@@ -1024,99 +1312,82 @@ void Model::Translate(float xtrans, float ytrans, float ztrans)
     }
     UpdateVertexArray();
 
-    int j;
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
+    boundingspherecenter.x += xtrans;
+    boundingspherecenter.y += ytrans;
+    boundingspherecenter.z += ztrans;
+
+    refitBVH();
 }
 
 void Model::Rotate(float xang, float yang, float zang)
 {
     MICROPROFILE_SCOPEI("Model", "Rotate", 0x008fff);
+    makeUnique();
     int i;
     for (i = 0; i < vertexNum; i++) {
         vertex[i] = DoRotation(vertex[i], xang, yang, zang);
     }
     UpdateVertexArray();
 
-    int j;
-    boundingsphereradius = 0;
-    for (i = 0; i < vertexNum; i++) {
-        for (j = 0; j < vertexNum; j++) {
-            if (j != i && distsq(&vertex[j], &vertex[i]) / 2 > boundingsphereradius) {
-                boundingsphereradius = distsq(&vertex[j], &vertex[i]) / 2;
-                boundingspherecenter = (vertex[i] + vertex[j]) / 2;
-            }
-        }
-    }
-    boundingsphereradius = fast_sqrt(boundingsphereradius);
+    boundingspherecenter = DoRotation(boundingspherecenter, xang, yang, zang);
+
+    refitBVH();
 }
 
 struct CalculateNormalsJob: WorkerThread::Job {
     int start_idx, end_idx;
     Model *model;
-    bool facenormalise;
-    CalculateNormalsJob(int s, int e, Model *m, bool fn):
+    CalculateNormalsJob(int s, int e, Model *m):
         Job(),
         start_idx(s),
         end_idx(e),
-        model(m),
-        facenormalise(fn)
+        model(m)
     {
         //--
     }
     void execute() override {
         MICROPROFILE_SCOPEI("Model", "CalculateNormalsJob", 0xe4a77c4);
-        std::vector<TexturedTriangle> &Triangles = model->Triangles;
+        TriangleList &Triangles = model->Triangles;
         XYZ *vertex = model->vertex;
-        XYZ *normals = model->normals;
 
         for(int i = start_idx; i <= end_idx; i++){
             XYZ v0 = vertex[Triangles[i].vertex[1]] - vertex[Triangles[i].vertex[0]];
             XYZ v1 = vertex[Triangles[i].vertex[2]] - vertex[Triangles[i].vertex[0]];
             cross3_neon(&v0.x, &v1.x, &Triangles[i].facenormal.x);
-
-            normals[Triangles[i].vertex[0]].x += Triangles[i].facenormal.x;
-            normals[Triangles[i].vertex[0]].y += Triangles[i].facenormal.y;
-            normals[Triangles[i].vertex[0]].z += Triangles[i].facenormal.z;
-
-            normals[Triangles[i].vertex[1]].x += Triangles[i].facenormal.x;
-            normals[Triangles[i].vertex[1]].y += Triangles[i].facenormal.y;
-            normals[Triangles[i].vertex[1]].z += Triangles[i].facenormal.z;
-
-            normals[Triangles[i].vertex[2]].x += Triangles[i].facenormal.x;
-            normals[Triangles[i].vertex[2]].y += Triangles[i].facenormal.y;
-            normals[Triangles[i].vertex[2]].z += Triangles[i].facenormal.z;
-            if (facenormalise) {
-                Normalise(&Triangles[i].facenormal);
-            }
         }
     }
 };
 
+/**
+ * Sums the (not yet normalised) face normals around each vertex, every job
+ * only writes its own vertices so no two jobs touch the same normal
+ * */
 struct NormalizeVertsJob: WorkerThread::Job {
     int start_idx, end_idx;
     Model *model;
-    NormalizeVertsJob(int s, int e, Model *m):
+    const int *cornerFirst;
+    const int *corners;
+    NormalizeVertsJob(int s, int e, Model *m, const int *first, const int *c):
         Job(),
         start_idx(s),
         end_idx(e),
-        model(m)
+        model(m),
+        cornerFirst(first),
+        corners(c)
     {
         //--
     }
     void execute() override {
         MICROPROFILE_SCOPEI("Model", "NormalizeVertsJob", 0xe4a77c4);
+        TriangleList &Triangles = model->Triangles;
         for (int i = start_idx; i <= end_idx; i++) {
-            Normalise(&model->normals[i]);
-            model->normals[i] *= -1;
+            XYZ normal;
+            for (int j = cornerFirst[i]; j < cornerFirst[i + 1]; j++) {
+                normal += Triangles[corners[j] / 3].facenormal;
+            }
+            Normalise(&normal);
+            normal *= -1;
+            model->normals[i] = normal;
         }
     }
 };
@@ -1124,16 +1395,18 @@ struct NormalizeVertsJob: WorkerThread::Job {
 struct UpdateVertexJob: WorkerThread::Job {
     unsigned int type, start_idx, end_idx;
     Model *model;
-    UpdateVertexJob(int t, int s, int e, Model *m):
+    bool facenormalise;
+    UpdateVertexJob(int t, int s, int e, Model *m, bool fn):
         Job(),
         type(t),
         start_idx(s),
         end_idx(e),
-        model(m)
+        model(m),
+        facenormalise(fn)
     {
         //--
     }
-    void update_notex(std::vector<TexturedTriangle> &Triangles, XYZ *vertex, XYZ *normals, GLfloat *vArray){
+    void update_notex(TriangleList &Triangles, XYZ *vertex, XYZ *normals, GLfloat *vArray){
         MICROPROFILE_SCOPEI("Model", "update_notex", 0xe4a77c4);
         if (model->type != normaltype && model->type != decalstype) {
             return;
@@ -1189,7 +1462,7 @@ struct UpdateVertexJob: WorkerThread::Job {
         }
     }
 
-    void update_notexnonorm(std::vector<TexturedTriangle> &Triangles, XYZ *vertex, GLfloat *vArray){
+    void update_notexnonorm(TriangleList &Triangles, XYZ *vertex, GLfloat *vArray){
         MICROPROFILE_SCOPEI("Model", "update_notexnonorm", 0xe4a77c4);
         if (model->type != normaltype && model->type != decalstype) {
             return;
@@ -1210,6 +1483,12 @@ struct UpdateVertexJob: WorkerThread::Job {
         }
     }
     void execute() override {
+        if (facenormalise) {
+            //the vertex normals have been summed from the raw face normals by now
+            for (unsigned int i = start_idx; i <= end_idx; i++) {
+                Normalise(&model->Triangles[i].facenormal);
+            }
+        }
         switch(type){
             default:
                 update_notex(model->Triangles, model->vertex, model->normals, model->vArray);
@@ -1221,20 +1500,23 @@ struct UpdateVertexJob: WorkerThread::Job {
     }
 };
 
-void Model::submitCalculateNormalsJobs_Phase1(
+void Model::submitCalculateNormalsJobs(
     bool facenormalise,
+    int updateType,
     WorkerThread::JobHandle dep,
     std::vector<WorkerThread::JobHandle> &out
 ){
-    for (int i = 0; i < vertexNum; i++) {
-        normals[i].x = 0;
-        normals[i].y = 0;
-        normals[i].z = 0;
+    if (type != normaltype && type != decalstype) {
+        return;
     }
+    makeUnique();
+    ASSERT(vertexCornerFirst.size() == (size_t)vertexNum + 1);
 
-    //Phase 1 (calculate normals)
+    //Phase 1 (face normals)
+    std::vector<WorkerThread::JobHandle> facejobs;
     size_t numtris = Triangles.size();
-    size_t p1_job_size = numtris / CALCNORM_JOB_SPLIT_DENOM;
+    size_t p1_split = jobSplit(CALCNORM_JOB_SPLIT_MIN, CALCNORM_JOB_SPLIT_MAX);
+    size_t p1_job_size = (numtris + p1_split - 1) / p1_split;
     if(p1_job_size == 0){
         p1_job_size = 1;
     }
@@ -1243,17 +1525,13 @@ void Model::submitCalculateNormalsJobs_Phase1(
         if(end >= numtris){
             end = numtris - 1;
         }
-        if(dep >= 0){
-            out.push_back(WorkerThread::submitDependentJob<CalculateNormalsJob>(dep, i, end, this, facenormalise));
-        }else{
-            out.push_back(WorkerThread::submitJob<CalculateNormalsJob>(i, end, this, facenormalise));
-        }
+        facejobs.push_back(WorkerThread::submitDependentJob<CalculateNormalsJob>(dep, i, end, this));
     }
-}
 
-void Model::submitCalculateNormalsJobs_Phase2(std::vector<WorkerThread::JobHandle> &out){
-    //Phase 2 (normalize verts)
-    size_t p2_job_size = vertexNum / NORM_VERTS_JOB_SPLIT_DENOM;
+    //Phase 2 (vertex normals, waits for every face normal)
+    std::vector<WorkerThread::JobHandle> vertjobs;
+    size_t p2_split = jobSplit(NORM_VERTS_JOB_SPLIT_MIN, NORM_VERTS_JOB_SPLIT_MAX);
+    size_t p2_job_size = (vertexNum + p2_split - 1) / p2_split;
     if(p2_job_size == 0){
         p2_job_size = 1;
     }
@@ -1262,13 +1540,30 @@ void Model::submitCalculateNormalsJobs_Phase2(std::vector<WorkerThread::JobHandl
         if(end >= vertexNum){
             end = vertexNum - 1;
         }
-        out.push_back(WorkerThread::submitJob<NormalizeVertsJob>(i, end, this));
+        vertjobs.push_back(WorkerThread::submitDependentJob<NormalizeVertsJob>(
+            facejobs, i, end, this, &vertexCornerFirst[0], vertexCorners.empty() ? nullptr : &vertexCorners[0]));
     }
+
+    //Phase 3 (vertex array, waits for every vertex normal)
+    submitUpdateVertexArrayJobs(updateType, facenormalise, vertjobs, out);
+
+    out.insert(out.end(), facejobs.begin(), facejobs.end());
+    out.insert(out.end(), vertjobs.begin(), vertjobs.end());
 }
 
-void Model::submitCalculateNormalsJobs_Phase3(int type, std::vector<WorkerThread::JobHandle> &out){
+void Model::submitUpdateVertexArrayJobs(int updateType, WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out){
+    std::vector<WorkerThread::JobHandle> deps;
+    if(dep >= 0){
+        deps.push_back(dep);
+    }
+    submitUpdateVertexArrayJobs(updateType, false, deps, out);
+}
+
+void Model::submitUpdateVertexArrayJobs(int updateType, bool facenormalise, const std::vector<WorkerThread::JobHandle> &deps, std::vector<WorkerThread::JobHandle> &out){
+    makeUnique();
     size_t numtris = Triangles.size();
-    size_t job_size = numtris / UPDATE_VERT_JOB_SPLIT_DENOM;
+    size_t split = jobSplit(UPDATE_VERT_JOB_SPLIT_MIN, UPDATE_VERT_JOB_SPLIT_MAX);
+    size_t job_size = (numtris + split - 1) / split;
     if(job_size == 0){
         job_size = 1;
     }
@@ -1278,7 +1573,7 @@ void Model::submitCalculateNormalsJobs_Phase3(int type, std::vector<WorkerThread
             end = numtris - 1;
         }
 
-        out.push_back(WorkerThread::submitJob<UpdateVertexJob>(type, i, end, this));
+        out.push_back(WorkerThread::submitDependentJob<UpdateVertexJob>(deps, updateType, i, end, this, facenormalise));
     }
 }
 
@@ -1290,6 +1585,7 @@ void Model::CalculateNormals(bool facenormalise)
     if (type != normaltype && type != decalstype) {
         return;
     }
+    makeUnique();
 
     for (int i = 0; i < vertexNum; i++) {
         normals[i].x = 0;
@@ -1723,17 +2019,23 @@ void Model::deallocate()
     }
     owner = 0;
 
-    if (vertex) {
-        free(vertex);
+    bool shared = sharedGeometry != nullptr;
+    if (shared) {
+        // owned by the cache entry
+        sharedGeometry = nullptr;
+    } else {
+        if (vertex) {
+            free(vertex);
+        }
+        if (normals) {
+            free(normals);
+        }
     }
     vertex = 0;
-
-    if (normals) {
-        free(normals);
-    }
     normals = 0;
+    Triangles.clear();
 
-    if (vArray) {
+    if (vArray && !shared) {
         #ifdef DRAW_SPEEDHACK
         if(vgl_array){
             vgl_free(vArray);
@@ -1747,6 +2049,11 @@ void Model::deallocate()
     vArray = 0;
 
     decals.clear();
+
+    bvh.clear();
+    bvhValid = false;
+    vertexCornerFirst.clear();
+    vertexCorners.clear();
 }
 
 Model::Model()
@@ -1761,6 +2068,7 @@ Model::Model()
     , boundingspherecenter()
     , boundingsphereradius(0)
     , flat(false)
+    , bvhValid(false)
 {
     memset(&modelTexture, 0, sizeof(modelTexture));
 }
@@ -24,6 +24,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Environment/Terrain.hpp"
 #include "Graphic/Texture.hpp"
 #include "Graphic/gamegl.hpp"
+#include "Math/AABBTree.hpp"
 #include "Math/XYZ.hpp"
 #include "Utils/binio.h"
 #include "Utils/WorkerThread.hpp"
@@ -31,6 +32,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <vector>
 
 //
@@ -46,6 +48,9 @@ typedef struct
 // Model Structures
 //
 
+struct CookedModelHeader;
+struct ModelCacheEntry;
+
 class TexturedTriangle
 {
 public:
@@ -53,6 +58,35 @@ public:
     float gx[3], gy[3];
     XYZ facenormal;
 };
+
+/**
+ * Triangle array of a Model. It either owns its triangles or points at the
+ * ones of a cached model (see Model::makeUnique), like Model::vertex.
+ * */
+class TriangleList
+{
+public:
+    TriangleList();
+    TriangleList(const TriangleList&) = delete;
+    TriangleList& operator=(const TriangleList&) = delete;
+
+    unsigned size() const { return count; }
+    bool empty() const { return count == 0; }
+    TexturedTriangle& operator[](unsigned i) { return data[i]; }
+    const TexturedTriangle& operator[](unsigned i) const { return data[i]; }
+
+    void resize(unsigned n);
+    void share(const TriangleList& other);
+    void copy(const TriangleList& other);
+    void clear();
+    bool isShared() const { return count > 0 && storage.empty(); }
+
+private:
+    std::vector<TexturedTriangle> storage;
+    TexturedTriangle* data;
+    unsigned count;
+};
+
 #define max_model_decals 300
 
 enum ModelType
@@ -75,7 +109,7 @@ public:
     XYZ* vertex;
     XYZ* normals;
     GLfloat* vArray;
-    std::vector<TexturedTriangle> Triangles;
+    TriangleList Triangles;
     bool vgl_array;
 
     /*
@@ -110,6 +144,7 @@ public:
     void UpdateVertexArray();
     void UpdateVertexArrayNoTex();
     void UpdateVertexArrayNoTexNoNorm();
+    void setVertexArrayNormal(int which, const XYZ& normal);
     bool loadnotex(const std::string& filename, bool cached=true);
     bool loadraw(const std::string& filename, bool cached=true);
     bool load(const std::string& filename, bool cached=true);
@@ -127,6 +162,14 @@ public:
     void Rotate(float xang, float yang, float zang);
     void deleteDeadDecals();
 
+    /* call after writing to vertex[] outside of Scale/Translate/Rotate */
+    void invalidateBVH();
+
+    /* models loaded from the cache share its geometry until this is called,
+     * which every member that modifies vertex, normals or Triangles does
+     * first. Call it before writing to them from anywhere else. */
+    void makeUnique();
+
     WorkerThread::JobHandle submitLoadnotex(const std::string &filename);
     WorkerThread::JobHandle submitLoad(const std::string &filename);
     WorkerThread::JobHandle submitLoadDecal(const std::string &filename);
@@ -134,17 +177,47 @@ public:
 
     WorkerThread::JobHandle submitTransformJob();
 
-    void submitCalculateNormalsJobs_Phase1(bool facenormalise, WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out);
-    void submitCalculateNormalsJobs_Phase2(std::vector<WorkerThread::JobHandle> &out);
-    void submitCalculateNormalsJobs_Phase3(int type, std::vector<WorkerThread::JobHandle> &out);
+    /**
+     * Same result as CalculateNormals, split into face normal, vertex normal
+     * and vertex array jobs chained after `dep`. Every handle is appended to
+     * `out` and must be joined by the caller.
+     * */
+    void submitCalculateNormalsJobs(bool facenormalise, int updateType, WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out);
+    void submitUpdateVertexArrayJobs(int updateType, WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out);
 
     static void initModelCache();
     static void clearModelCache();
 private:
 
     void deallocate();
+    bool shareCachedGeometry(const std::string& filename);
+    bool readMesh(const std::string& filename, bool withNormals);
+    bool readCooked(PHYSFS_File* tfile, const CookedModelHeader& header, bool withNormals);
+    bool readSolid(PHYSFS_File* tfile, bool withNormals);
+    void computeBoundingSphere();
+    void buildBVH();
+    void buildAdjacency();
+    void submitUpdateVertexArrayJobs(int updateType, bool facenormalise, const std::vector<WorkerThread::JobHandle> &deps, std::vector<WorkerThread::JobHandle> &out);
+    void refitBVH();
+    void getTriangleBounds(std::vector<AABB>& out) const;
+    const AABBTree& triangleTree() const;
+    void queryTriangles(const AABB& box, std::vector<unsigned>& out) const;
+    void queryTriangles(const XYZ& start, const XYZ& end, std::vector<unsigned>& out) const;
+
+    /* set while vertex, normals, Triangles, vArray, the tree and the
+     * adjacency lists are the ones of a cached model */
+    std::shared_ptr<const ModelCacheEntry> sharedGeometry;
+
     /* indices of triangles that might collide */
     std::vector<unsigned int> possible;
+
+    /* corners (triangle * 3 + corner) using each vertex, vertexCorners[vertexCornerFirst[v]..vertexCornerFirst[v + 1]) */
+    std::vector<int> vertexCornerFirst;
+    std::vector<int> vertexCorners;
+
+    /* triangle hierarchy for the collision checks, in model space */
+    AABBTree bvh;
+    bool bvhValid;
 };
 
 #endif
@@ -24,6 +24,9 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Thirdparty/microprofile/microprofile.h"
 #include "Objects/Person.hpp"
 
+#include <algorithm>
+#include <pthread.h>
+
 extern XYZ viewer;
 extern float viewdistance;
 extern float fadestart;
@@ -63,6 +66,124 @@ void Sprite::deleteSprites(){
 	sprites_count = 0;
 }
 
+/**
+ * Sprites spawned by the animation jobs, and the blood sprite hits they
+ * found. Each worker appends to its own queue, and the last one is shared by
+ * threads that only run jobs inside join(). flushSpawnQueues() applies them
+ * on the main thread once the jobs have been joined and the sprites drawn:
+ * new sprites are animated by the next frame's jobs before they are first
+ * drawn, and the skin and decal writers never run on more than one thread.
+ * */
+enum
+{
+	spawn_sprite = 0,
+	spawn_bloodplayer,
+	spawn_bloodobject,
+	spawn_bloodterrain
+};
+
+struct SpriteSpawn {
+	int source; //index of the sprite that spawned it, keeps the merge order stable
+	int kind;
+	int target; //player or object a blood sprite hit
+	int type;
+	XYZ where;
+	XYZ velocity;
+	float color[3];
+	float size;
+	float opacity;
+	float rotation;
+};
+
+static std::vector<SpriteSpawn> spawnQueues[WorkerThread::MAX_WORKERS + 1];
+static pthread_mutex_t mtxSpawnShared = PTHREAD_MUTEX_INITIALIZER;
+
+static void queueSpawn(const SpriteSpawn &spawn){
+	int worker = WorkerThread::currentWorker();
+	if(worker >= 0){
+		spawnQueues[worker].push_back(spawn);
+		return;
+	}
+
+	if(pthread_mutex_lock(&mtxSpawnShared)){
+		ASSERT(!"Failed to lock sprite spawn mutex");
+		return;
+	}
+	spawnQueues[WorkerThread::MAX_WORKERS].push_back(spawn);
+	if(pthread_mutex_unlock(&mtxSpawnShared)){
+		ASSERT(!"Failed to unlock sprite spawn mutex");
+	}
+}
+
+static void queueSprite(int source, int type, XYZ where, XYZ velocity, float red, float green, float blue, float size, float opacity){
+	SpriteSpawn spawn;
+	spawn.source = source;
+	spawn.kind = spawn_sprite;
+	spawn.target = -1;
+	spawn.type = type;
+	spawn.where = where;
+	spawn.velocity = velocity;
+	spawn.color[0] = red;
+	spawn.color[1] = green;
+	spawn.color[2] = blue;
+	spawn.size = size;
+	spawn.opacity = opacity;
+	spawn.rotation = 0;
+	queueSpawn(spawn);
+}
+
+static void queueBlood(int source, int kind, int target, XYZ where, float size, float rotation){
+	SpriteSpawn spawn;
+	spawn.source = source;
+	spawn.kind = kind;
+	spawn.target = target;
+	spawn.type = bloodsprite;
+	spawn.where = where;
+	spawn.velocity = 0;
+	spawn.color[0] = spawn.color[1] = spawn.color[2] = 0;
+	spawn.size = size;
+	spawn.opacity = 0;
+	spawn.rotation = rotation;
+	queueSpawn(spawn);
+}
+
+void Sprite::flushSpawnQueues(){
+	MICROPROFILE_SCOPEI("Sprite", "flushSpawnQueues", 0x55ff55);
+	static std::vector<SpriteSpawn> merged;
+	merged.clear();
+	for(int i = 0; i <= WorkerThread::MAX_WORKERS; i++){
+		merged.insert(merged.end(), spawnQueues[i].begin(), spawnQueues[i].end());
+		spawnQueues[i].clear();
+	}
+
+	//which worker ran which range varies from frame to frame
+	std::stable_sort(merged.begin(), merged.end(), [](const SpriteSpawn &a, const SpriteSpawn &b){
+		return a.source < b.source;
+	});
+
+	for(size_t i = 0; i < merged.size(); i++){
+		const SpriteSpawn &spawn = merged[i];
+		switch(spawn.kind){
+			case spawn_sprite:
+				MakeSprite(spawn.type, spawn.where, spawn.velocity, spawn.color[0], spawn.color[1], spawn.color[2], spawn.size, spawn.opacity);
+				break;
+			case spawn_bloodplayer:
+				if(spawn.target < (int)Person::players.size()){
+					Person::players[spawn.target]->DoBloodBigWhere(0, 160, spawn.where);
+				}
+				break;
+			case spawn_bloodobject:
+				if(spawn.target < (int)Object::objects.size()){
+					Object::objects[spawn.target]->model.MakeDecal(blooddecalfast, spawn.where, spawn.size, .5, spawn.rotation);
+				}
+				break;
+			case spawn_bloodterrain:
+				terrain.MakeDecal(blooddecalfast, spawn.where, spawn.size, .6, spawn.rotation);
+				break;
+		}
+	}
+}
+
 struct AnimateSprites: WorkerThread::Job {
 	float mat[4][4];
 	int start_idx, end_idx;
@@ -88,7 +209,9 @@ void Sprite::submitAnimationJob(std::vector<WorkerThread::JobHandle> &out){
 		checkdelay = 1;
 	}
 
-	int sprites_per_job = ceil((float)sprites_count / 3.0f);
+	//one range per worker, plus one for the thread that joins them
+	int jobs = WorkerThread::workerCount() + 1;
+	int sprites_per_job = ceil((float)sprites_count / jobs);
 
 	MICROPROFILE_COUNTER_SET("sprites_per_job", sprites_per_job);
 
@@ -96,8 +219,9 @@ void Sprite::submitAnimationJob(std::vector<WorkerThread::JobHandle> &out){
 	glMatrixMode(GL_MODELVIEW);
 	glGetFloatv(GL_MODELVIEW_MATRIX, &mmodel[0][0]);
 
+	//ranges are inclusive and must not overlap, each sprite belongs to one job
 	for(size_t start = 0; start < sprites_count; start += sprites_per_job){
-		size_t end = start + sprites_per_job;
+		size_t end = start + sprites_per_job - 1;
 		if(end >= sprites_count){
 			end = sprites_count - 1;
 		}
@@ -120,7 +244,9 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 
 		{MICROPROFILE_SCOPEI("Sprite", "anim", 0x5555ff);
 
-		multiplier = tempmult;
+		//other jobs run this loop at the same time, scale a local copy
+		//instead of the global
+		float multiplier = tempmult;
 		if (sprite->type != snowsprite) {
 			sprite->position += sprite->velocity * multiplier;
 			sprite->velocity += windvector * multiplier;
@@ -176,8 +302,8 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 			}
 		}
 
-		//TODO: move bloodsprite processing to main thread since it probably isn't thread safe
-		//accesses Terrain::patchobjects, Person::players, Object::objects
+		//only reads Terrain::patchobjects, Person::players and Object::objects,
+		//the hits are queued and painted by flushSpawnQueues()
 		if (sprite->type == bloodsprite) {
 			bool spritehit = 0;
 			sprite->rotation += multiplier * 100;
@@ -187,7 +313,6 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 				float rotationpoint;
 				int whichtri;
 
-				//TODO: check if Person::DoBloodBigWhere is thread safe
 				for (unsigned j = 0; j < Person::players.size(); j++) {
 					if (!spritehit && Person::players[j]->dead && sprite->alivetime > .1) {
 						where = sprite->oldposition;
@@ -208,24 +333,24 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 						whichtri = Person::players[j]->skeleton.drawmodel.LineCheck(&startpoint, &endpoint, &footpoint, &movepoint, &rotationpoint);
 						if (whichtri != -1) {
 							spritehit = 1;
-							Person::players[j]->DoBloodBigWhere(0, 160, sprite->oldposition);
+							queueBlood(i, spawn_bloodplayer, j, sprite->oldposition, 0, 0);
 							DeleteSprite(i);
 						}
 					}
 				}
 
-				int whichpatchx = sprite->position.x / (terrain.size / subdivision * terrain.scale);
-				int whichpatchz = sprite->position.z / (terrain.size / subdivision * terrain.scale);
-				if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < subdivision && whichpatchz < subdivision) {
+				int whichpatchx = sprite->position.x / (terrain.size / terrain.subdivision * terrain.scale);
+				int whichpatchz = sprite->position.z / (terrain.size / terrain.subdivision * terrain.scale);
+				if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < terrain.subdivision && whichpatchz < terrain.subdivision) {
 					if (!spritehit) {
 						for (unsigned int j = 0; j < terrain.patchobjects[whichpatchx][whichpatchz].size(); j++) {
-							int k = terrain.patchobjects[whichpatchx][whichpatchz][j];
+							int k = terrain.patchObject(whichpatchx, whichpatchz, j);
 							start = sprite->oldposition;
 							end = sprite->position;
 							if (!spritehit) {
 								if (Object::objects[k]->model.LineCheck(&start, &end, &colpoint, &Object::objects[k]->position, &Object::objects[k]->yaw) != -1) {
 									if (detail == 2 || (detail == 1 && abs(Random() % 4) == 0) || (detail == 0 && abs(Random() % 8) == 0)) {
-										Object::objects[k]->model.MakeDecal(blooddecalfast, DoRotation(colpoint - Object::objects[k]->position, 0, -Object::objects[k]->yaw, 0), sprite->size * 1.6, .5, Random() % 360);
+										queueBlood(i, spawn_bloodobject, k, DoRotation(colpoint - Object::objects[k]->position, 0, -Object::objects[k]->yaw, 0), sprite->size * 1.6, Random() % 360);
 									}
 									DeleteSprite(i);
 									spritehit = 1;
@@ -236,7 +361,7 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 				}
 				if (!spritehit) {
 					if (sprite->position.y < terrain.getHeight(sprite->position.x, sprite->position.z)) {
-						terrain.MakeDecal(blooddecalfast, sprite->position, sprite->size * 1.6, .6, Random() % 360);
+						queueBlood(i, spawn_bloodterrain, -1, sprite->position, sprite->size * 1.6, Random() % 360);
 						DeleteSprite(i);
 					}
 				}
@@ -255,7 +380,7 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 			sprite->opacity -= multiplier * 5 / 4;
 			if (sprite->type != weaponshinesprite && sprite->type != bloodflamesprite) {
 				if (sprite->opacity < .5 && sprite->opacity + multiplier * 5 / 4 >= .5 && (abs(Random() % 4) == 0 || (sprite->initialsize > 2 && Random() % 2 == 0))) {
-					MakeSprite(smoketype, sprite->position, sprite->velocity, .9, .9, .6, sprite->size * 1.2, .4);
+					queueSprite(i, smoketype, sprite->position, sprite->velocity, .9, .9, .6, sprite->size * 1.2, .4);
 				}
 			}
 			if (sprite->alivetime > .14 && (sprite->type == flamesprite)) {
@@ -329,8 +454,6 @@ void Sprite::doAnimate(float (&mmodel)[4][4], int start_idx, int end_idx){
 			sprite->oldposition = sprite->position;
 		}
 	}
-
-	multiplier = tempmult;
 }
 
 void Sprite::setLastSpriteSpecial(int s){
@@ -355,21 +478,132 @@ void Sprite::setLastSpriteAlivetime(float al){
 	sprites[last].alivetime = al;
 }
 
+/* sprites sharing a texture and blend state are drawn together, in this
+ * order: alpha blended first, then the additive ones */
+enum
+{
+	batch_cloud = 0,
+	batch_cloudimpact,
+	batch_smoke,
+	batch_blood,
+	batch_splinter,
+	batch_leaf,
+	batch_snowflake,
+	batch_tooth,
+	batch_shine,
+	batch_flame,
+	batch_bloodflame,
+	batch_count
+};
+
+struct SpriteBatch
+{
+	Texture *texture;
+	GLenum srcblend, dstblend;
+	float alpharef;
+	std::vector<GLfloat> vertices; // x y z, r g b a, s t
+};
+
+#define SPRITE_VERTEX_FLOATS 9
+
+static SpriteBatch batches[batch_count] = {
+	{ &Sprite::cloudtexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::cloudimpacttexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::smoketexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::bloodtexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::splintertexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::leaftexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::snowflaketexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::toothtexture, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 0.0001f, {} },
+	{ &Sprite::shinetexture, GL_SRC_ALPHA, GL_ONE, 0.001f, {} },
+	{ &Sprite::flametexture, GL_SRC_ALPHA, GL_ONE, 0.3f, {} },
+	{ &Sprite::bloodflametexture, GL_ONE, GL_ZERO, 0.3f, {} },
+};
+
+int Sprite::batchIndex() const
+{
+	switch (type) {
+		case cloudsprite:
+			return batch_cloud;
+		case breathsprite:
+		case cloudimpactsprite:
+			return batch_cloudimpact;
+		case smoketype:
+			return batch_smoke;
+		case bloodsprite:
+			return batch_blood;
+		case splintersprite:
+			if (special == 1) {
+				return batch_leaf;
+			}
+			if (special == 2) {
+				return batch_snowflake;
+			}
+			if (special == 3) {
+				return batch_tooth;
+			}
+			return batch_splinter;
+		case snowsprite:
+			return batch_snowflake;
+		case weaponshinesprite:
+			return batch_shine;
+		case flamesprite:
+		case weaponflamesprite:
+			return batch_flame;
+		case bloodflamesprite:
+			return batch_bloodflame;
+	}
+	return -1;
+}
+
+static void setColor(float (&c)[4], float r, float g, float b, float a)
+{
+	c[0] = r;
+	c[1] = g;
+	c[2] = b;
+	c[3] = a;
+}
+
+/* the quad the old glTranslatef/glRotatef/glScalef path drew, in view space */
+static void pushQuad(std::vector<GLfloat> &out, const XYZ &rpoint, float rotation, float size, const float (&c)[4])
+{
+	static const float corners[6][4] = {
+		{ .5f, .5f, 1, 1 },
+		{ -.5f, .5f, 0, 1 },
+		{ .5f, -.5f, 1, 0 },
+		{ -.5f, -.5f, 0, 0 },
+		{ .5f, -.5f, 1, 0 },
+		{ -.5f, .5f, 0, 1 },
+	};
+	float rad = DEG_TO_RAD(rotation);
+	float cs = cosf(rad) * size;
+	float sn = sinf(rad) * size;
+
+	size_t base = out.size();
+	out.resize(base + 6 * SPRITE_VERTEX_FLOATS);
+	GLfloat *v = &out[base];
+	for (int i = 0; i < 6; i++) {
+		v[0] = rpoint.x + corners[i][0] * cs - corners[i][1] * sn;
+		v[1] = rpoint.y + corners[i][0] * sn + corners[i][1] * cs;
+		v[2] = rpoint.z;
+		v[3] = c[0];
+		v[4] = c[1];
+		v[5] = c[2];
+		v[6] = c[3];
+		v[7] = corners[i][2];
+		v[8] = corners[i][3];
+		v += SPRITE_VERTEX_FLOATS;
+	}
+}
+
 //Functions
 void Sprite::Draw()
 {
 	MICROPROFILE_SCOPEI("Sprite", "Draw", 0x008fff);
-	//float M[16];
-	XYZ point;
 	float distancemult = 0;
-	int lasttype = 0;
-	int lastspecial = 0;
-	//bool check = 0;
-	bool blend = 0;
-	//float tempmult = 0;
-	XYZ difference;
 	float lightcolor[3] = {0,0,0};
 	float viewdistsquared = viewdistance * viewdistance;
+	float color[4];
 	XYZ tempviewer;
 
 	tempviewer = viewer + viewerfacing * 6;
@@ -379,120 +613,21 @@ void Sprite::Draw()
 	lightcolor[1] = light.color[1] * .5 + light.ambient[1];
 	lightcolor[2] = light.color[2] * .5 + light.ambient[2];
 
-	lasttype = -1;
-	lastspecial = -1;
-	glEnable(GL_BLEND);
-	glDisable(GL_LIGHTING);
-	glDisable(GL_CULL_FACE);
-	glEnable(GL_TEXTURE_2D);
-	blend = 1;
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDepthMask(0);
-	glAlphaFunc(GL_GREATER, 0.0001);
-
 	MICROPROFILE_COUNTER_SET("Sprites", sprites_count);
-	{MICROPROFILE_SCOPEI("Sprite", "render", 0x55ff55);
+	{MICROPROFILE_SCOPEI("Sprite", "batch", 0x55ff55);
+
+	for (int b = 0; b < batch_count; b++) {
+		batches[b].vertices.clear();
+	}
 
 	for (size_t i = 0; i < sprites_count; i++) {
 		Sprite *sprite = &sprites[i];
 		if(!sprite->alive){
 			continue;
 		}
-		{MICROPROFILE_SCOPEI("Sprite", "draw", 0x55ff55);
-		//draw
-		//TODO: separate sprites by type to minimize binding calls
-
-		if (lasttype != sprite->type) {
-			MICROPROFILE_SCOPEI("Sprite", "rebind", 0xffff00);
-			switch (sprite->type) {
-				case cloudsprite:
-					cloudtexture.bind();
-					if (!blend) {
-						blend = 1;
-						glAlphaFunc(GL_GREATER, 0.0001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-					}
-					break;
-				case breathsprite:
-				case cloudimpactsprite:
-					cloudimpacttexture.bind();
-					if (!blend) {
-						blend = 1;
-						glAlphaFunc(GL_GREATER, 0.0001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-					}
-					break;
-				case smoketype:
-					smoketexture.bind();
-					if (!blend) {
-						blend = 1;
-						glAlphaFunc(GL_GREATER, 0.0001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-					}
-					break;
-				case bloodsprite:
-					bloodtexture.bind();
-					if (!blend) {
-						blend = 1;
-						glAlphaFunc(GL_GREATER, 0.0001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-					}
-					break;
-				case splintersprite:
-					if (lastspecial != sprite->special) {
-						if (sprite->special == 0) {
-							splintertexture.bind();
-						}
-						if (sprite->special == 1) {
-							leaftexture.bind();
-						}
-						if (sprite->special == 2) {
-							snowflaketexture.bind();
-						}
-						if (sprite->special == 3) {
-							toothtexture.bind();
-						}
-						if (!blend) {
-							blend = 1;
-							glAlphaFunc(GL_GREATER, 0.0001);
-							glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-						}
-					}
-					break;
-				case snowsprite:
-					snowflaketexture.bind();
-					if (!blend) {
-						blend = 1;
-						glAlphaFunc(GL_GREATER, 0.0001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-					}
-					break;
-				case weaponshinesprite:
-					shinetexture.bind();
-					if (blend) {
-						blend = 0;
-						glAlphaFunc(GL_GREATER, 0.001);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-					}
-					break;
-				case flamesprite:
-				case weaponflamesprite:
-					flametexture.bind();
-					if (blend || lasttype == bloodflamesprite) {
-						blend = 0;
-						glAlphaFunc(GL_GREATER, 0.3);
-						glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-					}
-					break;
-				case bloodflamesprite:
-					bloodflametexture.bind();
-					if (blend) {
-						blend = 0;
-						glAlphaFunc(GL_GREATER, 0.3);
-						glBlendFunc(GL_ONE, GL_ZERO);
-					}
-					break;
-			}
+		int batch = sprite->batchIndex();
+		if (batch < 0) {
+			continue;
 		}
 
 		if (sprite->type == snowsprite) {
@@ -502,83 +637,98 @@ void Sprite::Draw()
 		}
 		if (sprite->type == flamesprite) {
 			if (distancemult >= 1) {
-				glColor4f(sprite->color[0], sprite->color[1], sprite->color[2], sprite->opacity);
+				setColor(color, sprite->color[0], sprite->color[1], sprite->color[2], sprite->opacity);
 			} else {
-				glColor4f(sprite->color[0], sprite->color[1], sprite->color[2], sprite->opacity * distancemult);
+				setColor(color, sprite->color[0], sprite->color[1], sprite->color[2], sprite->opacity * distancemult);
 			}
 		} else {
 			if (distancemult >= 1) {
-				glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity);
+				setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity);
 			} else {
-				glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * distancemult);
+				setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * distancemult);
 			}
 		}
 
-		lasttype = sprite->type;
-		lastspecial = sprite->special;
-
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		glLoadIdentity();
-
-		glTranslatef(sprite->rpoint.x, sprite->rpoint.y, sprite->rpoint.z);
-		glRotatef(sprite->rotation, 0, 0, 1);
-
+		float size = sprite->size;
 		if ((sprite->type == flamesprite || sprite->type == weaponflamesprite || sprite->type == weaponshinesprite || sprite->type == bloodflamesprite)) {
 			if (sprite->alivetime < .14) {
-				glScalef(sprite->alivetime / .14, sprite->alivetime / .14, sprite->alivetime / .14);
+				size *= sprite->alivetime / .14;
 			}
 		}
 		if (sprite->type == smoketype || sprite->type == snowsprite || sprite->type == weaponshinesprite || sprite->type == breathsprite) {
 			if (sprite->alivetime < .3) {
 				if (distancemult >= 1) {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * sprite->alivetime / .3);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * sprite->alivetime / .3);
 				}
 				if (distancemult < 1) {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * distancemult * sprite->alivetime / .3);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->opacity * distancemult * sprite->alivetime / .3);
 				}
 			}
 		}
 		if (sprite->type == splintersprite && sprite->special > 0 && sprite->special != 3) {
 			if (sprite->alivetime < .2) {
 				if (distancemult >= 1) {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->alivetime / .2);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], sprite->alivetime / .2);
 				} else {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult * sprite->alivetime / .2);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult * sprite->alivetime / .2);
 				}
 			} else {
 				if (distancemult >= 1) {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], 1);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], 1);
 				} else {
-					glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult);
+					setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult);
 				}
 			}
 		}
 		if (sprite->type == splintersprite && (sprite->special == 0 || sprite->special == 3)) {
 			if (distancemult >= 1) {
-				glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], 1);
+				setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], 1);
 			} else {
-				glColor4f(sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult);
+				setColor(color, sprite->color[0] * lightcolor[0], sprite->color[1] * lightcolor[1], sprite->color[2] * lightcolor[2], distancemult);
 			}
 		}
 
-		glBegin(GL_TRIANGLES);
-		glTexCoord2f(1.0f, 1.0f);
-		glVertex3f(.5 * sprite->size, .5 * sprite->size, 0.0f);
-		glTexCoord2f(0.0f, 1.0f);
-		glVertex3f(-.5 * sprite->size, .5 * sprite->size, 0.0f);
-		glTexCoord2f(1.0f, 0.0f);
-		glVertex3f(.5 * sprite->size, -.5 * sprite->size, 0.0f);
-		glTexCoord2f(0.0f, 0.0f);
-		glVertex3f(-.5 * sprite->size, -.5 * sprite->size, 0.0f);
-		glTexCoord2f(1.0f, 0.0f);
-		glVertex3f(.5 * sprite->size, -.5 * sprite->size, 0.0f);
-		glTexCoord2f(0.0f, 1.0f);
-		glVertex3f(-.5 * sprite->size, .5 * sprite->size, 0.0f);
-		glEnd();
-		glPopMatrix();
-		}//MICROPROFILE
+		pushQuad(batches[batch].vertices, sprite->rpoint, sprite->rotation, size, color);
+	}
+	}//MICROPROFILE
+
+	{MICROPROFILE_SCOPEI("Sprite", "render", 0x55ff55);
+
+	glEnable(GL_BLEND);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_TEXTURE_2D);
+	glDepthMask(0);
+
+	// rpoint is already in view space
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	for (int b = 0; b < batch_count; b++) {
+		SpriteBatch &batch = batches[b];
+		if (batch.vertices.empty()) {
+			continue;
+		}
+		batch.texture->bind();
+		glAlphaFunc(GL_GREATER, batch.alpharef);
+		glBlendFunc(batch.srcblend, batch.dstblend);
+
+		glVertexPointer(3, GL_FLOAT, SPRITE_VERTEX_FLOATS * sizeof(GLfloat), &batch.vertices[0]);
+		glColorPointer(4, GL_FLOAT, SPRITE_VERTEX_FLOATS * sizeof(GLfloat), &batch.vertices[3]);
+		glTexCoordPointer(2, GL_FLOAT, SPRITE_VERTEX_FLOATS * sizeof(GLfloat), &batch.vertices[7]);
+		glDrawArrays(GL_TRIANGLES, 0, batch.vertices.size() / SPRITE_VERTEX_FLOATS);
 	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	glPopMatrix();
 	}//MICROPROFILE
 
 	glAlphaFunc(GL_GREATER, 0.0001);
@@ -72,6 +72,7 @@ private:
     static float checkdelay;
 
     float calcDistanceMult(Sprite *spr);
+    int batchIndex() const;
 public:
     static void AllocSprites(int count);
 
@@ -79,6 +80,10 @@ public:
 
     static void doAnimate(float (&mat)[4][4], int start_idx, int end_idx);
 
+    /* adds the sprites the animation jobs spawned and paints their blood
+     * hits, call on the main thread after joining them */
+    static void flushSpawnQueues();
+
     static void DeleteSprite(int which);
     static void MakeSprite(int atype, XYZ where, XYZ avelocity, float red, float green, float blue, float asize, float aopacity);
     static void Draw();
@@ -23,6 +23,9 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Game.hpp"
 #include "Thirdparty/microprofile/microprofile.h"
 
+#include <string.h>
+#include <vector>
+
 void Text::LoadFontTexture(const std::string& fileName)
 {   
     LOGFUNC;
@@ -107,11 +110,16 @@ void Text::_glPrint(float x, float y, const std::string& string, int set, float
     //glListBase(base - 32 + (128 * set) + offset);      // Choose The Font Set (0 or 1)
     //glCallLists(end - start, GL_BYTE, &string[start]); // Write The Text To The Screen
 
-    //vitaGL drawlists don't work right...
-    
+    //vitaGL drawlists don't work right, so the string is laid out into one
+    //vertex array (two triangles per character) and drawn in a single call
+    static std::vector<GLfloat> vertices; // x y s t
+    vertices.resize((end > start ? end - start : 0) * 6 * 4);
+
     int off = base - 32 + (128 * set) + offset;
     float cx;
     float cy;
+    float pen = 0;
+    GLfloat* v = vertices.empty() ? nullptr : &vertices[0];
     for (int i = start; i < end; i++) {
         int Ch = string[i] + off;
         if (Ch < 256) {
@@ -121,23 +129,34 @@ void Text::_glPrint(float x, float y, const std::string& string, int set, float
             cx = float((Ch - 256) % 16) / 16.0f;
             cy = float((Ch - 256) / 16) / 16.0f;
         }
-        glBegin(GL_QUADS);
-        glTexCoord2f(cx, 1 - cy - 0.0625f + .001);
-        glVertex2i(0, 0);
-        glTexCoord2f(cx + 0.0625f, 1 - cy - 0.0625f + .001);
-        glVertex2i(16, 0);
-        glTexCoord2f(cx + 0.0625f, 1 - cy - .001);
-        glVertex2i(16, 16);
-        glTexCoord2f(cx, 1 - cy - +.001);
-        glVertex2i(0, 16);
-        glEnd();
+        const GLfloat quad[4][4] = {
+            { pen, 0, cx, 1 - cy - 0.0625f + .001f },
+            { pen + 16, 0, cx + 0.0625f, 1 - cy - 0.0625f + .001f },
+            { pen + 16, 16, cx + 0.0625f, 1 - cy - .001f },
+            { pen, 16, cx, 1 - cy - .001f },
+        };
+        static const int corners[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int c = 0; c < 6; c++) {
+            memcpy(v, quad[corners[c]], sizeof(quad[0]));
+            v += 4;
+        }
         if (Ch < 256) {
-            glTranslated(10, 0, 0);
+            pen += 10;
         } else {
-            glTranslated(8, 0, 0);
+            pen += 8;
         }
     }
 
+    if (!vertices.empty()) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), &vertices[0]);
+        glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), &vertices[2]);
+        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 4);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
@@ -25,12 +25,39 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Utils/ImageIO.hpp"
 #include "Utils/Log.h"
 #include <assert.h>
+#include <pthread.h>
+#include <unordered_map>
 
 using namespace std;
 
 extern PVRTexLoader *pvr_loader;
 extern bool trilinear;
 
+static pthread_mutex_t mtxRegistry = PTHREAD_MUTEX_INITIALIZER;
+/* keyed by resolved path and mipmap flag, see registryKeyFor */
+static std::unordered_map<string, std::weak_ptr<TextureRes>> textureRegistry;
+
+static string registryKeyFor(const string& path, bool hasMipmap){
+	return path + (hasMipmap ? "|mip" : "|nomip");
+}
+
+static void evictShared(const string& key){
+	if(pthread_mutex_lock(&mtxRegistry)){
+		ASSERT(!"Failed to lock texture registry mutex");
+		return;
+	}
+
+	//the key may already belong to a newer TextureRes
+	auto found = textureRegistry.find(key);
+	if(found != textureRegistry.end() && found->second.expired()){
+		textureRegistry.erase(found);
+	}
+
+	if(pthread_mutex_unlock(&mtxRegistry)){
+		ASSERT(!"Failed to unlock texture registry mutex");
+	}
+}
+
 void TextureRes::uploadPVR(void *pTexture){
 	MICROPROFILE_SCOPEI("TextureRes", "uploadPVR", 0x008fff);
 	ImageRec *texture = (ImageRec*) pTexture;
@@ -141,6 +168,8 @@ void TextureRes::loadData(){
 	if(!load_image(filename.c_str(), *img)){
 		LOG("WARN: failed to load texture: %s", filename.c_str());
 	}
+	//last thing, so a LoadImageDataJob sets it before it can be joined
+	decoded.store(true);
 }
 
 void TextureRes::uploadTexture(){
@@ -182,6 +211,7 @@ void TextureRes::uploadTexture(){
 
 	delete img;
 	loadimg = nullptr;
+	loadJob = -1;
 }
 
 void TextureRes::load()
@@ -251,6 +281,8 @@ TextureRes::TextureRes(const string& _filename, bool _hasMipmap)
 	, data(NULL)
 	, datalen(0)
 	, loadimg(nullptr)
+	, loadJob(-1)
+	, decoded(true)
 {
 	//load();
 }
@@ -264,6 +296,8 @@ TextureRes::TextureRes(const string& _filename, bool _hasMipmap, GLubyte* array,
 	, data(NULL)
 	, datalen(0)
 	, loadimg(nullptr)
+	, loadJob(-1)
+	, decoded(true)
 {
 	/*
 	load();
@@ -281,13 +315,64 @@ TextureRes::~TextureRes()
 	}
 	data = NULL;
 	glDeleteTextures(1, &id);
+
+	if(!registryKey.empty()){
+		evictShared(registryKey);
+	}
+}
+
+std::shared_ptr<TextureRes> Texture::findShared(const string& path, bool hasMipmap)
+{
+	if(pthread_mutex_lock(&mtxRegistry)){
+		ASSERT(!"Failed to lock texture registry mutex");
+		return nullptr;
+	}
+
+	std::shared_ptr<TextureRes> ret = nullptr;
+	auto found = textureRegistry.find(registryKeyFor(path, hasMipmap));
+	if(found != textureRegistry.end()){
+		ret = found->second.lock();
+	}
+
+	if(pthread_mutex_unlock(&mtxRegistry)){
+		ASSERT(!"Failed to unlock texture registry mutex");
+	}
+	return ret;
+}
+
+void Texture::registerShared(const std::shared_ptr<TextureRes>& res)
+{
+	res->registryKey = registryKeyFor(res->filename, res->hasMipmap);
+
+	if(pthread_mutex_lock(&mtxRegistry)){
+		ASSERT(!"Failed to lock texture registry mutex");
+		return;
+	}
+
+	textureRegistry[res->registryKey] = res;
+
+	if(pthread_mutex_unlock(&mtxRegistry)){
+		ASSERT(!"Failed to unlock texture registry mutex");
+	}
 }
 
 void Texture::load(const string& filename, bool hasMipmap)
 {
-	TextureRes *tr = new TextureRes(Folders::getResourcePath(filename), hasMipmap);
+	const string path = Folders::getResourcePath(filename);
+	std::shared_ptr<TextureRes> shared = findShared(path, hasMipmap);
+	if(shared && shared->loadJob < 0){
+		tex = shared;
+		return;
+	}
+
+	//a copy still being decoded for submitLoadJob can't be used yet, so
+	//this one is loaded privately
+	TextureRes *tr = new TextureRes(path, hasMipmap);
 	tex.reset(tr);
 	tex->load();
+	if(!shared){
+		registerShared(tex);
+	}
 }
 
 void Texture::load(const string& filename, bool hasMipmap, GLubyte* array, int* skinsizep)
@@ -325,10 +410,39 @@ struct LoadImageDataJob: WorkerThread::Job {
 	}
 };
 
+//handed out for textures another submitLoadJob already covers
+struct TextureReadyJob: WorkerThread::Job {
+	TextureReadyJob():
+		Job()
+	{
+		//--
+	}
+	~TextureReadyJob() = default;
+	void execute() override {
+		//--
+	}
+};
+
 WorkerThread::JobHandle Texture::submitLoadJob(const string& filename, bool hasMipmap){
-	TextureRes *tr = new TextureRes(Folders::getResourcePath(filename), hasMipmap);
+	const string path = Folders::getResourcePath(filename);
+	std::shared_ptr<TextureRes> shared = findShared(path, hasMipmap);
+	if(shared){
+		tex = shared;
+		//while the shared image is still being decoded its job can't have
+		//been joined, so it's safe to wait on, and whichever user joins
+		//first can upload it. Loads are submitted and joined on one thread
+		if(!shared->decoded.load()){
+			return WorkerThread::submitDependentJob<TextureReadyJob>(shared->loadJob);
+		}
+		return WorkerThread::submitJob<TextureReadyJob>();
+	}
+
+	TextureRes *tr = new TextureRes(path, hasMipmap);
 	tex.reset(tr);
-	return WorkerThread::submitJob<LoadImageDataJob>(tex);
+	registerShared(tex);
+	tex->decoded.store(false);
+	tex->loadJob = WorkerThread::submitJob<LoadImageDataJob>(tex);
+	return tex->loadJob;
 }
 WorkerThread::JobHandle Texture::submitLoadJob(const string& filename, bool hasMipmap, GLubyte* array, int* skinsizep){
 	//TODO
@@ -337,6 +451,9 @@ WorkerThread::JobHandle Texture::submitLoadJob(const string& filename, bool hasM
 }
 
 void Texture::upload(){
-	tex->uploadTexture();
+	//shared textures are uploaded by the first of their users to get here
+	if(tex->loadimg != nullptr){
+		tex->uploadTexture();
+	}
 }
 
@@ -24,6 +24,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Graphic/gamegl.hpp"
 #include "Utils/WorkerThread.hpp"
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -44,6 +45,9 @@ private:
     bool is_pvr;
 
     void *loadimg;
+    WorkerThread::JobHandle loadJob; // LoadImageDataJob, -1 once uploaded
+    std::atomic<bool> decoded;       // set when loadJob has finished, the handle may be stale after that
+    string registryKey;              // empty for textures kept out of the registry
 
     void uploadPVR(void *texture);
 
@@ -62,11 +66,21 @@ public:
     TextureRes& operator=(TextureRes const& other) = delete;
 };
 
+/**
+ * Non-skin textures are shared through a registry keyed on the resolved path
+ * and load flags, so loading the same image twice decodes and uploads it once.
+ * The registry only holds weak references: a TextureRes is evicted as soon as
+ * the last Texture using it is reloaded or destroyed. Skins are never shared
+ * since every Person paints blood into its own copy.
+ * */
 class Texture
 {
 private:
     std::shared_ptr<TextureRes> tex;
 
+    static std::shared_ptr<TextureRes> findShared(const string& path, bool hasMipmap);
+    static void registerShared(const std::shared_ptr<TextureRes>& res);
+
 public:
     inline Texture()
         : tex(nullptr)
@@ -0,0 +1,280 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Math/AABBTree.hpp"
+
+#include "Utils/Log.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <math.h>
+
+#define AABBTREE_LEAF_SIZE 4
+#define AABBTREE_STACK_SIZE 64
+
+AABB::AABB()
+{
+    reset();
+}
+
+void AABB::reset()
+{
+    for (int i = 0; i < 3; i++) {
+        min[i] = FLT_MAX;
+        max[i] = -FLT_MAX;
+    }
+}
+
+void AABB::expand(const XYZ& point)
+{
+    min[0] = std::min(min[0], point.x);
+    min[1] = std::min(min[1], point.y);
+    min[2] = std::min(min[2], point.z);
+    max[0] = std::max(max[0], point.x);
+    max[1] = std::max(max[1], point.y);
+    max[2] = std::max(max[2], point.z);
+}
+
+void AABB::expand(const AABB& box)
+{
+    for (int i = 0; i < 3; i++) {
+        min[i] = std::min(min[i], box.min[i]);
+        max[i] = std::max(max[i], box.max[i]);
+    }
+}
+
+void AABB::pad(float amount)
+{
+    for (int i = 0; i < 3; i++) {
+        min[i] -= amount;
+        max[i] += amount;
+    }
+}
+
+bool AABB::overlaps(const AABB& box) const
+{
+    return min[0] <= box.max[0] && max[0] >= box.min[0] &&
+           min[1] <= box.max[1] && max[1] >= box.min[1] &&
+           min[2] <= box.max[2] && max[2] >= box.min[2];
+}
+
+AABB AABB::fromSphere(const XYZ& center, float radius)
+{
+    AABB ret;
+    ret.min[0] = center.x - radius;
+    ret.min[1] = center.y - radius;
+    ret.min[2] = center.z - radius;
+    ret.max[0] = center.x + radius;
+    ret.max[1] = center.y + radius;
+    ret.max[2] = center.z + radius;
+    return ret;
+}
+
+AABBTree::AABBTree()
+{
+    //--
+}
+
+void AABBTree::clear()
+{
+    nodes.clear();
+    indices.clear();
+}
+
+bool AABBTree::empty() const
+{
+    return nodes.empty();
+}
+
+unsigned AABBTree::size() const
+{
+    return indices.size();
+}
+
+void AABBTree::build(const std::vector<AABB>& boxes)
+{
+    clear();
+    if (boxes.empty()) {
+        return;
+    }
+
+    indices.resize(boxes.size());
+    for (unsigned i = 0; i < indices.size(); i++) {
+        indices[i] = i;
+    }
+
+    // a balanced tree has at most 2n/leafsize nodes, plus slack for odd splits
+    nodes.reserve(2 * (boxes.size() / AABBTREE_LEAF_SIZE + 1));
+    buildNode(boxes, 0, boxes.size());
+}
+
+int AABBTree::buildNode(const std::vector<AABB>& boxes, unsigned first, unsigned count)
+{
+    int id = nodes.size();
+    nodes.push_back(Node());
+
+    Node node;
+    node.right = -1;
+    node.first = first;
+    node.count = count;
+
+    AABB centers;
+    for (unsigned i = first; i < first + count; i++) {
+        const AABB& b = boxes[indices[i]];
+        node.box.expand(b);
+
+        XYZ c;
+        c.x = (b.min[0] + b.max[0]) * .5f;
+        c.y = (b.min[1] + b.max[1]) * .5f;
+        c.z = (b.min[2] + b.max[2]) * .5f;
+        centers.expand(c);
+    }
+
+    if (count > AABBTREE_LEAF_SIZE) {
+        // median split along the longest axis of the centroid bounds
+        int axis = 0;
+        for (int i = 1; i < 3; i++) {
+            if (centers.max[i] - centers.min[i] > centers.max[axis] - centers.min[axis]) {
+                axis = i;
+            }
+        }
+
+        unsigned half = count / 2;
+        std::nth_element(
+            indices.begin() + first,
+            indices.begin() + first + half,
+            indices.begin() + first + count,
+            [&boxes, axis](unsigned a, unsigned b) {
+                return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+            });
+
+        buildNode(boxes, first, half);
+        node.right = buildNode(boxes, first + half, count - half);
+        node.first = 0;
+        node.count = 0;
+    }
+
+    nodes[id] = node;
+    return id;
+}
+
+void AABBTree::refit(const std::vector<AABB>& boxes)
+{
+    ASSERT(boxes.size() == indices.size());
+
+    // children are always stored after their parent
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        Node& node = nodes[i];
+        node.box.reset();
+        if (node.count) {
+            for (unsigned j = node.first; j < node.first + node.count; j++) {
+                node.box.expand(boxes[indices[j]]);
+            }
+        } else {
+            node.box.expand(nodes[i + 1].box);
+            node.box.expand(nodes[node.right].box);
+        }
+    }
+}
+
+void AABBTree::queryBox(const AABB& box, std::vector<unsigned>& out) const
+{
+    out.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    int stack[AABBTREE_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!node.box.overlaps(box)) {
+            continue;
+        }
+        if (node.count) {
+            out.insert(out.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+        } else {
+            ASSERT(top + 2 <= AABBTREE_STACK_SIZE);
+            stack[top++] = node.right;
+            stack[top++] = &node - &nodes[0] + 1;
+        }
+    }
+
+    std::sort(out.begin(), out.end());
+}
+
+static bool segmentOverlaps(const AABB& box, const float* start, const float* dir)
+{
+    float t0 = 0;
+    float t1 = 1;
+    for (int i = 0; i < 3; i++) {
+        if (fabs(dir[i]) < 0.0000001f) {
+            if (start[i] < box.min[i] || start[i] > box.max[i]) {
+                return false;
+            }
+            continue;
+        }
+        float inv = 1.f / dir[i];
+        float ta = (box.min[i] - start[i]) * inv;
+        float tb = (box.max[i] - start[i]) * inv;
+        if (ta > tb) {
+            std::swap(ta, tb);
+        }
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AABBTree::querySegment(const XYZ& start, const XYZ& end, std::vector<unsigned>& out) const
+{
+    out.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    const float s[3] = { start.x, start.y, start.z };
+    const float d[3] = { end.x - start.x, end.y - start.y, end.z - start.z };
+
+    int stack[AABBTREE_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!segmentOverlaps(node.box, s, d)) {
+            continue;
+        }
+        if (node.count) {
+            out.insert(out.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+        } else {
+            ASSERT(top + 2 <= AABBTREE_STACK_SIZE);
+            stack[top++] = node.right;
+            stack[top++] = &node - &nodes[0] + 1;
+        }
+    }
+
+    std::sort(out.begin(), out.end());
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AABBTREE_HPP_
+#define _AABBTREE_HPP_
+
+#include "Math/XYZ.hpp"
+
+#include <vector>
+
+struct AABB
+{
+    float min[3];
+    float max[3];
+
+    AABB();
+
+    void reset();
+    void expand(const XYZ& point);
+    void expand(const AABB& box);
+    void pad(float amount);
+    bool overlaps(const AABB& box) const;
+
+    static AABB fromSphere(const XYZ& center, float radius);
+};
+
+/**
+ * Static bounding volume hierarchy over a list of boxes (e.g. the triangles
+ * of a Model). Queries return the indices of every box in the leaves they
+ * reach, so callers still do their own exact test on each one. The list is
+ * sorted ascending to keep the same first-hit order as a linear scan.
+ *
+ * build() chooses the topology, refit() only recomputes the node bounds, so
+ * it is cheap to call again after the boxes have been moved around.
+ * */
+class AABBTree
+{
+public:
+    AABBTree();
+
+    void build(const std::vector<AABB>& boxes);
+    void refit(const std::vector<AABB>& boxes);
+    void clear();
+    bool empty() const;
+    unsigned size() const;
+
+    void queryBox(const AABB& box, std::vector<unsigned>& out) const;
+    void querySegment(const XYZ& start, const XYZ& end, std::vector<unsigned>& out) const;
+
+private:
+    struct Node
+    {
+        AABB box;
+        int right;      // left child is always the next node
+        unsigned first; // leaves only: range into indices
+        unsigned count; // 0 for inner nodes
+    };
+
+    int buildNode(const std::vector<AABB>& boxes, unsigned first, unsigned count);
+
+    std::vector<Node> nodes;
+    std::vector<unsigned> indices;
+};
+
+#endif
@@ -23,8 +23,21 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdlib>
 
+/* set while a job runs, see WorkerThread::executeJob */
+extern thread_local bool jobRandomActive;
+extern thread_local unsigned jobRandomState;
+
+/**
+ * Jobs draw from their own stream, seeded when they are submitted, so that
+ * neither their results nor the main rand() sequence depend on which
+ * thread ran them or when
+ * */
 static inline short Random()
 {
+    if (jobRandomActive) {
+        jobRandomState = jobRandomState * 1103515245 + 12345;
+        return (jobRandomState >> 16) & 0x7fff;
+    }
     return rand();
 }
 
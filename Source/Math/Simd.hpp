@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SIMD_HPP_
+#define _SIMD_HPP_
+
+/**
+ * Minimal 4-wide float vector wrappers over NEON or SSE, VEC4_SIMD is 0
+ * when neither is available and callers fall back to their scalar loops.
+ * */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define VEC4_SIMD 1
+    typedef float32x4_t vec4;
+    #define VEC4_SPLAT(f) vdupq_n_f32(f)
+    #define VEC4_LOAD(p) vld1q_f32(p)
+    #define VEC4_STORE(p, v) vst1q_f32(p, v)
+    #define VEC4_MUL(a, b) vmulq_f32(a, b)
+    #define VEC4_MADD(a, b, c) vmlaq_f32(a, b, c) // a + b * c
+    #define VEC4_TRUNC(a) vcvtq_f32_s32(vcvtq_s32_f32(a))
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define VEC4_SIMD 1
+    typedef __m128 vec4;
+    #define VEC4_SPLAT(f) _mm_set1_ps(f)
+    #define VEC4_LOAD(p) _mm_loadu_ps(p)
+    #define VEC4_STORE(p, v) _mm_storeu_ps(p, v)
+    #define VEC4_MUL(a, b) _mm_mul_ps(a, b)
+    #define VEC4_MADD(a, b, c) _mm_add_ps(a, _mm_mul_ps(b, c))
+    #define VEC4_TRUNC(a) _mm_cvtepi32_ps(_mm_cvttps_epi32(a))
+#else
+    #define VEC4_SIMD 0
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Math/SpatialGrid.hpp"
+
+#include "Utils/Log.h"
+
+#include <algorithm>
+#include <math.h>
+
+#define SPATIALGRID_BUCKETS 256 // power of two
+#define SPATIALGRID_MAX_CELL 1000000
+
+SpatialGrid::SpatialGrid(float cellsize)
+    : cellsize(cellsize)
+    , buckets(SPATIALGRID_BUCKETS)
+    , count(0)
+{
+    ASSERT(cellsize > 0);
+}
+
+void SpatialGrid::clear()
+{
+    for (unsigned i = 0; i < buckets.size(); i++) {
+        buckets[i].clear();
+    }
+    bucketOf.clear();
+    count = 0;
+}
+
+unsigned SpatialGrid::size() const
+{
+    return count;
+}
+
+int SpatialGrid::cell(float coord) const
+{
+    float c = floorf(coord / cellsize);
+    // also catches NaN, which never passes the caller's distance test anyway
+    if (!(c > -SPATIALGRID_MAX_CELL)) {
+        return -SPATIALGRID_MAX_CELL;
+    }
+    if (c > SPATIALGRID_MAX_CELL) {
+        return SPATIALGRID_MAX_CELL;
+    }
+    return (int)c;
+}
+
+unsigned SpatialGrid::bucket(int x, int z) const
+{
+    return ((unsigned)x * 73856093u ^ (unsigned)z * 19349663u) & (SPATIALGRID_BUCKETS - 1);
+}
+
+void SpatialGrid::insert(unsigned id, const XYZ& point)
+{
+    if (id >= bucketOf.size()) {
+        bucketOf.resize(id + 1, -1);
+    }
+    ASSERT(bucketOf[id] == -1);
+
+    unsigned b = bucket(cell(point.x), cell(point.z));
+    buckets[b].push_back(id);
+    bucketOf[id] = b;
+    count++;
+}
+
+void SpatialGrid::move(unsigned id, const XYZ& point)
+{
+    ASSERT(id < bucketOf.size() && bucketOf[id] != -1);
+
+    unsigned b = bucket(cell(point.x), cell(point.z));
+    if ((int)b == bucketOf[id]) {
+        return;
+    }
+
+    std::vector<unsigned>& old = buckets[bucketOf[id]];
+    old.erase(std::find(old.begin(), old.end(), id));
+    buckets[b].push_back(id);
+    bucketOf[id] = b;
+}
+
+void SpatialGrid::query(const XYZ& center, float radius, std::vector<unsigned>& out) const
+{
+    out.clear();
+
+    int x0 = cell(center.x - radius);
+    int x1 = cell(center.x + radius);
+    int z0 = cell(center.z - radius);
+    int z1 = cell(center.z + radius);
+
+    if ((double)(x1 - x0 + 1) * (z1 - z0 + 1) >= SPATIALGRID_BUCKETS) {
+        // the square covers the whole table anyway
+        for (unsigned i = 0; i < buckets.size(); i++) {
+            out.insert(out.end(), buckets[i].begin(), buckets[i].end());
+        }
+        std::sort(out.begin(), out.end());
+        return;
+    }
+
+    for (int x = x0; x <= x1; x++) {
+        for (int z = z0; z <= z1; z++) {
+            const std::vector<unsigned>& b = buckets[bucket(x, z)];
+            out.insert(out.end(), b.begin(), b.end());
+        }
+    }
+
+    // different cells can share a bucket
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
@@ -0,0 +1,61 @@
+/*
+Copyright (C) 2003, 2010 - Wolfire Games
+Copyright (C) 2010-2017 - Lugaru contributors (see AUTHORS file)
+
+This file is part of Lugaru.
+
+Lugaru is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+Lugaru is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPATIALGRID_HPP_
+#define _SPATIALGRID_HPP_
+
+#include "Math/XYZ.hpp"
+
+#include <vector>
+
+/**
+ * Uniform grid over points on the xz plane, used as a broad-phase between
+ * things that move every tick (players, weapons). Cells are hashed into a
+ * fixed table of buckets, so clear() and insert() don't allocate once the
+ * buckets have grown. Queries return every id in the cells a square around
+ * the center touches, sorted ascending to keep the same order as a linear
+ * scan; callers still do their own exact distance test.
+ *
+ * Positions are a snapshot: whoever moves an entry while iterating has to
+ * call move() for it.
+ * */
+class SpatialGrid
+{
+public:
+    SpatialGrid(float cellsize);
+
+    void clear();
+    void insert(unsigned id, const XYZ& point);
+    void move(unsigned id, const XYZ& point);
+    unsigned size() const;
+
+    void query(const XYZ& center, float radius, std::vector<unsigned>& out) const;
+
+private:
+    int cell(float coord) const;
+    unsigned bucket(int x, int z) const;
+
+    float cellsize;
+    std::vector<std::vector<unsigned>> buckets;
+    std::vector<int> bucketOf; // -1 for ids that were never inserted
+    unsigned count;
+};
+
+#endif
@@ -45,6 +45,12 @@ Texture Object::boxtextureptr;
 Texture Object::treetextureptr;
 Texture Object::bushtextureptr;
 Texture Object::rocktextureptr;
+AABBTree Object::tree;
+std::vector<unsigned> Object::treeObjects;
+bool Object::treeValid = false;
+
+/* scratch list for checkcollide, which also runs on worker threads */
+static thread_local std::vector<unsigned> treeCandidates;
 
 //Functions
 
@@ -205,11 +211,11 @@ void Object::doShadows(XYZ lightloc)
         for (int j = 0; j < model.vertexNum; j++) {
             terrainpoint = position + DoRotation(model.vertex[j] + model.normals[j] * .1, 0, yaw, 0);
             shadowed = 0;
-            patchx = terrainpoint.x / (terrain.size / subdivision * terrain.scale);
-            patchz = terrainpoint.z / (terrain.size / subdivision * terrain.scale);
-            if (patchx >= 0 && patchz >= 0 && patchx < subdivision && patchz < subdivision) {
+            patchx = terrainpoint.x / (terrain.size / terrain.subdivision * terrain.scale);
+            patchz = terrainpoint.z / (terrain.size / terrain.subdivision * terrain.scale);
+            if (patchx >= 0 && patchz >= 0 && patchx < terrain.subdivision && patchz < terrain.subdivision) {
                 for (unsigned int k = 0; k < terrain.patchobjects[patchx][patchz].size(); k++) {
-                    unsigned int l = terrain.patchobjects[patchx][patchz][k];
+                    unsigned int l = terrain.patchObject(patchx, patchz, k);
                     if (objects[l]->type != treetrunktype) {
                         testpoint = terrainpoint;
                         testpoint2 = terrainpoint + lightloc * 50 * (1 - shadowed);
@@ -222,26 +228,7 @@ void Object::doShadows(XYZ lightloc)
             if (shadowed > 0) {
                 col = model.normals[j] - DoRotation(lightloc * shadowed, 0, -yaw, 0);
                 Normalise(&col);
-                for (unsigned int k = 0; k < model.Triangles.size(); k++) {
-                    if (model.Triangles[k].vertex[0] == j) {
-                        int l = k * 24;
-                        model.vArray[l + 2] = col.x;
-                        model.vArray[l + 3] = col.y;
-                        model.vArray[l + 4] = col.z;
-                    }
-                    if (model.Triangles[k].vertex[1] == j) {
-                        int l = k * 24;
-                        model.vArray[l + 10] = col.x;
-                        model.vArray[l + 11] = col.y;
-                        model.vArray[l + 12] = col.z;
-                    }
-                    if (model.Triangles[k].vertex[2] == j) {
-                        int l = k * 24;
-                        model.vArray[l + 18] = col.x;
-                        model.vArray[l + 19] = col.y;
-                        model.vArray[l + 20] = col.z;
-                    }
-                }
+                model.setVertexArrayNormal(j, col);
             }
         }
     }
@@ -572,6 +559,7 @@ void Object::LoadObjectsFromFile(PHYSFS_File* tfile, bool skip)
     funpackf(tfile, "Bi", &numobjects);
     if (!skip) {
         objects.clear();
+        treeValid = false;
     }
     for (int i = 0; i < numobjects; i++) {
         funpackf(tfile, "Bi Bf Bf Bf Bf Bf Bf", &type, &yaw, &pitch, &position.x, &position.y, &position.z, &scale);
@@ -589,6 +577,7 @@ void Object::LoadObjectsFromJson(Json::Value values)
 {
     MICROPROFILE_SCOPEI("Object", "LoadObjectsFromJson", 0x008fff);
     objects.clear();
+    treeValid = false;
     float lastscale = 1.0f;
     for (unsigned i = 0; i < values.size(); i++) {
         objects.emplace_back(new Object(values[i], lastscale));
@@ -620,18 +609,48 @@ void Object::AddObjectsToTerrain()
     for (unsigned i = 0; i < objects.size(); i++) {
         objects[i]->addToTerrain(i);
     }
+    BuildTree();
+}
+
+bool Object::blocksSight() const
+{
+    return type != treeleavestype && type != bushtype && type != firetype;
+}
+
+/**
+ * Objects never move once placed, so the tree is only rebuilt when the
+ * level is loaded or the editor adds or deletes one
+ * */
+void Object::BuildTree()
+{
+    MICROPROFILE_SCOPEI("Object", "BuildTree", 0x008fff);
+    std::vector<AABB> bounds;
+    treeObjects.clear();
+    for (unsigned i = 0; i < objects.size(); i++) {
+        Object& object = *objects[i];
+        if (!object.blocksSight()) {
+            continue;
+        }
+        // LineCheck rejects anything that misses this sphere
+        XYZ center = object.position + DoRotation(object.model.boundingspherecenter, 0, object.yaw, 0);
+        bounds.push_back(AABB::fromSphere(center, object.model.boundingsphereradius));
+        bounds.back().pad(.01f);
+        treeObjects.push_back(i);
+    }
+    tree.build(bounds);
+    treeValid = true;
 }
 
 void Object::SphereCheckPossible(XYZ* p1, float radius)
 {
     MICROPROFILE_SCOPEI("Object", "SphereCheckPossible", 0x008fff);
-    int whichpatchx = p1->x / (terrain.size / subdivision * terrain.scale);
-    int whichpatchz = p1->z / (terrain.size / subdivision * terrain.scale);
+    int whichpatchx = p1->x / (terrain.size / terrain.subdivision * terrain.scale);
+    int whichpatchz = p1->z / (terrain.size / terrain.subdivision * terrain.scale);
 
-    if (whichpatchx >= 0 && whichpatchz >= 0 && whichpatchx < subdivision && whichpatchz < subdivision) {
+    if (whichpatchx >= 0 && whichpatchz >= 0 && whichpatchx < terrain.subdivision && whichpatchz < terrain.subdivision) {
         if (terrain.patchobjects[whichpatchx][whichpatchz].size() < 500) {
             for (unsigned int j = 0; j < terrain.patchobjects[whichpatchx][whichpatchz].size(); j++) {
-                unsigned int i = terrain.patchobjects[whichpatchx][whichpatchz][j];
+                unsigned int i = terrain.patchObject(whichpatchx, whichpatchz, j);
                 objects[i]->possible = false;
                 if (objects[i]->model.SphereCheckPossible(p1, radius, &objects[i]->position, &objects[i]->yaw) != -1) {
                     objects[i]->possible = true;
@@ -667,6 +686,7 @@ void Object::DeleteObject(int which)
 {
     objects.erase(objects.begin() + which);
     terrain.DeleteObject(which);
+    BuildTree();
 }
 
 void Object::MakeObject(int atype, XYZ where, float ayaw, float apitch, float ascale)
@@ -676,6 +696,7 @@ void Object::MakeObject(int atype, XYZ where, float ayaw, float apitch, float as
         unsigned nextid = objects.size();
         objects.emplace_back(new Object(object_type(atype), where, ayaw, apitch, ascale));
         objects.back()->addToTerrain(nextid);
+        BuildTree();
     }
 }
 
@@ -687,6 +708,32 @@ void Object::DoStuff()
     }
 }
 
+#define SHADOW_JOBS_PER_WORKER 4
+
+struct ObjectShadowJob: WorkerThread::Job {
+    unsigned first, last;
+    XYZ lightloc;
+    ObjectShadowJob(unsigned f, unsigned l, XYZ loc):
+        Job(),
+        first(f),
+        last(l),
+        lightloc(loc)
+    {
+        //--
+    }
+    void execute() override {
+        MICROPROFILE_SCOPEI("Object", "ObjectShadowJob", 0x008fff);
+        for (unsigned i = first; i <= last; i++) {
+            Object::objects[i]->doShadows(lightloc);
+        }
+    }
+};
+
+/**
+ * Each object only writes its own vertex array and reads the others'
+ * geometry, so ranges of objects are shaded in parallel. Ranges are cut by
+ * vertex count since that is what the work grows with.
+ * */
 void Object::DoShadows()
 {
     MICROPROFILE_SCOPEI("Object", "DoShadows", 0x008fff);
@@ -698,8 +745,26 @@ void Object::DoShadows()
     lightloc.y += 10;
     Normalise(&lightloc);
 
+    unsigned total = 0;
+    for (unsigned i = 0; i < objects.size(); i++) {
+        total += objects[i]->model.vertexNum;
+    }
+    unsigned perjob = total / ((WorkerThread::workerCount() + 1) * SHADOW_JOBS_PER_WORKER) + 1;
+
+    std::vector<WorkerThread::JobHandle> jobs;
+    unsigned first = 0;
+    unsigned count = 0;
     for (unsigned i = 0; i < objects.size(); i++) {
-        objects[i]->doShadows(lightloc);
+        count += objects[i]->model.vertexNum;
+        if (count >= perjob || i + 1 == objects.size()) {
+            jobs.push_back(WorkerThread::submitJob<ObjectShadowJob>(first, i, lightloc));
+            first = i + 1;
+            count = 0;
+        }
+    }
+
+    for (auto& job : jobs) {
+        WorkerThread::join(job, true);
     }
 }
 
@@ -715,6 +780,19 @@ int Object::checkcollide(XYZ startpoint, XYZ endpoint)
     maxy = max(startpoint.y, endpoint.y) + 1;
     maxz = max(startpoint.z, endpoint.z) + 1;
 
+    if (treeValid) {
+        // leaves come back sorted, so the first hit is still the lowest index
+        std::vector<unsigned>& candidates = treeCandidates;
+        tree.querySegment(startpoint, endpoint, candidates);
+        for (unsigned int c = 0; c < candidates.size(); c++) {
+            const unsigned int i = treeObjects[candidates[c]];
+            if (checkcollide(startpoint, endpoint, i, minx, miny, minz, maxx, maxy, maxz) != -1) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
     for (unsigned int i = 0, ct = objects.size(); i < ct; i++) {
         if (checkcollide(startpoint, endpoint, i, minx, miny, minz, maxx, maxy, maxz) != -1) {
             return (int)i;
@@ -755,9 +833,7 @@ int Object::checkcollide(XYZ startpoint, XYZ endpoint, int what, float minx, flo
             objects[what]->position.y < maxy + objects[what]->model.boundingsphereradius &&
             objects[what]->position.z > minz - objects[what]->model.boundingsphereradius &&
             objects[what]->position.z < maxz + objects[what]->model.boundingsphereradius) {
-            if (objects[what]->type != treeleavestype &&
-                objects[what]->type != bushtype &&
-                objects[what]->type != firetype) {
+            if (objects[what]->blocksSight()) {
                 colviewer = startpoint;
                 coltarget = endpoint;
                 if (objects[what]->model.LineCheck(&colviewer, &coltarget, &colpoint, &objects[what]->position, &objects[what]->yaw) != -1) {
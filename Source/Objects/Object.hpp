@@ -27,6 +27,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Graphic/Sprite.hpp"
 #include "Graphic/Texture.hpp"
 #include "Graphic/gamegl.hpp"
+#include "Math/AABBTree.hpp"
 #include "Math/Frustum.hpp"
 #include "Math/XYZ.hpp"
 #include "Utils/ImageIO.hpp"
@@ -106,17 +107,26 @@ public:
     static void DoStuff();
     static int checkcollide(XYZ startpoint, XYZ endpoint);
     static int checkcollide(XYZ startpoint, XYZ endpoint, int what);
+    static void BuildTree();
 
     operator Json::Value();
 
+    void doShadows(XYZ lightloc);
+
 private:
     void handleFire();
     void handleRot(int divide);
-    void doShadows(XYZ lightloc);
     void draw();
     void drawSecondPass();
     void addToTerrain(unsigned id);
     static int checkcollide(XYZ startpoint, XYZ endpoint, int what, float minx, float miny, float minz, float maxx, float maxy, float maxz);
+    bool blocksSight() const;
+
+    /* hierarchy over the bounding spheres of the objects that can block a
+     * line, in world space; treeObjects maps its leaves back to objects */
+    static AABBTree tree;
+    static std::vector<unsigned> treeObjects;
+    static bool treeValid;
 };
 
 #endif
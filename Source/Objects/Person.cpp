@@ -24,6 +24,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Audio/Sounds.hpp"
 #include "Audio/openal_wrapper.hpp"
 #include "Game.hpp"
+#include "Graphic/ClothesCompositor.hpp"
 #include "Level/Awards.hpp"
 #include "Level/Dialog.hpp"
 #include "Tutorial.hpp"
@@ -33,6 +34,8 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Thirdparty/microprofile/microprofile.h"
 #include "Thirdparty/vitagl/math_utils.h"
 
+#include <pthread.h>
+
 extern float multiplier;
 extern Terrain terrain;
 extern float gravity;
@@ -41,6 +44,7 @@ extern int detail;
 extern FRUSTUM frustum;
 extern XYZ viewer;
 extern float realmultiplier;
+extern float tickalpha;
 extern int slomo;
 extern float slomodelay;
 extern bool cellophane;
@@ -78,6 +82,18 @@ extern XYZ windvector;
 
 std::vector<std::shared_ptr<Person>> Person::players;
 
+// about the reach of the player-vs-player tests in GameTick
+SpatialGrid Person::grid(3);
+
+void Person::updateGrid()
+{
+    MICROPROFILE_SCOPEI("Person", "updateGrid", 0xaaffaa);
+    grid.clear();
+    for (unsigned i = 0; i < players.size(); i++) {
+        grid.insert(i, players[i]->coords);
+    }
+}
+
 Person::Person()
     : updatedelaychange(0)
     , morphness(0)
@@ -116,6 +132,7 @@ Person::Person()
     realoldcoords()
     , oldcoords()
     , coords()
+    , tickcoords()
     , velocity()
 
     , unconscioustime(0)
@@ -167,6 +184,11 @@ Person::Person()
     , bleedy(0)
     , direction(0)
     , texupdatedelay(0)
+    , skinDirtyFirstRow(SKINTEX_SQSIZE)
+    , skinDirtyLastRow(-1)
+    , skinDirtyFirstCol(SKINTEX_SQSIZE)
+    , skinDirtyLastCol(-1)
+    , skinUploadQueued(false)
     ,
 
     headyaw(0)
@@ -457,6 +479,7 @@ Person::Person(PHYSFS_File* tfile, int mapvers, unsigned i)
 
     oldcoords = coords;
     realoldcoords = coords;
+    tickcoords = coords;
 }
 
 void Person::changeCreatureType(person_type type)
@@ -809,6 +832,94 @@ void Person::DoBlood(float howmuch, int which)
  * spawns big blood effects and ???
  * modifies character's skin texture
  */
+// blood is also painted from sprite jobs (DoBloodBigWhere)
+static pthread_mutex_t mtxSkinDirty = PTHREAD_MUTEX_INITIALIZER;
+
+/* grows the part of skinText that updateSkinTexture() uploads, bounds are inclusive */
+void Person::markSkinDirty(int firstrow, int firstcol, int lastrow, int lastcol)
+{
+    if (lastrow < firstrow || lastcol < firstcol) {
+        return;
+    }
+
+    if(pthread_mutex_lock(&mtxSkinDirty)){
+        ASSERT(!"Failed to lock skin dirty mutex");
+        return;
+    }
+
+    skinDirtyFirstRow = min(skinDirtyFirstRow, firstrow);
+    skinDirtyLastRow = max(skinDirtyLastRow, lastrow);
+    skinDirtyFirstCol = min(skinDirtyFirstCol, firstcol);
+    skinDirtyLastCol = max(skinDirtyLastCol, lastcol);
+
+    if(pthread_mutex_unlock(&mtxSkinDirty)){
+        ASSERT(!"Failed to unlock skin dirty mutex");
+    }
+}
+
+/* painters can run on worker threads without a GL context, so they only
+ * ask for the upload and DrawSkeleton does it */
+void Person::queueSkinUpload()
+{
+    if(pthread_mutex_lock(&mtxSkinDirty)){
+        ASSERT(!"Failed to lock skin dirty mutex");
+        return;
+    }
+
+    skinUploadQueued = true;
+
+    if(pthread_mutex_unlock(&mtxSkinDirty)){
+        ASSERT(!"Failed to unlock skin dirty mutex");
+    }
+}
+
+/**
+ * Uploads only the painted rectangle of skinText with glTexSubImage2D, if
+ * an upload was queued. Main thread only. Rows are copied into a scratch
+ * buffer padded to the default unpack alignment of 4 bytes. Skins are
+ * loaded without mipmaps, so there are no other levels to refresh.
+ * */
+void Person::updateSkinTexture()
+{
+    MICROPROFILE_SCOPEI("Person", "updateSkinTexture", 0xaaffaa);
+
+    if(pthread_mutex_lock(&mtxSkinDirty)){
+        ASSERT(!"Failed to lock skin dirty mutex");
+        return;
+    }
+
+    bool queued = skinUploadQueued;
+    int firstrow = max(skinDirtyFirstRow, 0);
+    int firstcol = max(skinDirtyFirstCol, 0);
+    int lastrow = min(skinDirtyLastRow, skeleton.skinsize - 1);
+    int lastcol = min(skinDirtyLastCol, skeleton.skinsize - 1);
+    if (queued) {
+        skinUploadQueued = false;
+        skinDirtyFirstRow = skinDirtyFirstCol = SKINTEX_SQSIZE;
+        skinDirtyLastRow = skinDirtyLastCol = -1;
+    }
+
+    if(pthread_mutex_unlock(&mtxSkinDirty)){
+        ASSERT(!"Failed to unlock skin dirty mutex");
+    }
+
+    if (!queued || lastrow < firstrow || lastcol < firstcol) {
+        return;
+    }
+
+    int width = lastcol - firstcol + 1;
+    int height = lastrow - firstrow + 1;
+    int pitch = (width * 3 + 3) & ~3;
+
+    std::vector<GLubyte> rect(pitch * height);
+    for (int i = 0; i < height; i++) {
+        memcpy(&rect[i * pitch], &skeleton.skinText[((firstrow + i) * skeleton.skinsize + firstcol) * 3], width * 3);
+    }
+
+    skeleton.drawmodel.textureptr.bind();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, firstcol, firstrow, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rect[0]);
+}
+
 void Person::DoBloodBig(float howmuch, int which)
 {
     MICROPROFILE_SCOPEI("Person", "DoBloodBig", 0xaaffaa);
@@ -968,8 +1079,8 @@ void Person::DoBloodBig(float howmuch, int which)
                 }
             }
         }
-        skeleton.drawmodel.textureptr.bind();
-        DoMipmaps();
+        markSkinDirty(startx, starty, endx - 1, endy - 1);
+        queueSkinUpload();
 
         bleedxint = 0;
         bleedyint = 0;
@@ -1185,8 +1296,8 @@ bool Person::DoBloodBigWhere(float howmuch, int which, XYZ where)
                 }
             }
         }
-        skeleton.drawmodel.textureptr.bind();
-        DoMipmaps();
+        markSkinDirty(startx, starty, endx - 1, endy - 1);
+        queueSkinUpload();
 
         bleedy = (1 + coordsy) * BLOOD_TEX_SIZE;
         bleedx = coordsx * BLOOD_TEX_SIZE;
@@ -1901,10 +2012,10 @@ void Person::RagDoll(bool checkcollision)
                 }
             }
 
-            whichpatchx = coords.x / (terrain.size / subdivision * terrain.scale);
-            whichpatchz = coords.z / (terrain.size / subdivision * terrain.scale);
+            whichpatchx = coords.x / (terrain.size / terrain.subdivision * terrain.scale);
+            whichpatchz = coords.z / (terrain.size / terrain.subdivision * terrain.scale);
             for (unsigned int l = 0; l < terrain.patchobjects[whichpatchx][whichpatchz].size(); l++) {
-                i = terrain.patchobjects[whichpatchx][whichpatchz][l];
+                i = terrain.patchObject(whichpatchx, whichpatchz, l);
                 lowpoint = coords;
                 lowpoint.y += 1;
                 if (SphereCheck(&lowpoint, 3, &colpoint, &Object::objects[i]->position, &Object::objects[i]->yaw, &Object::objects[i]->model) != -1) {
@@ -4647,9 +4758,8 @@ void Person::DoStuff()
     if (bleeding > 0) {
         bleeding -= multiplier * .3;
         if (bloodtoggle == 2) {
-            skeleton.drawmodel.textureptr.bind();
             if ((bleeding <= 0) && (detail != 2)) {
-                DoMipmaps();
+                queueSkinUpload();
             }
         }
     }
@@ -4789,9 +4899,9 @@ void Person::DoStuff()
                 }
             }
         }
+        markSkinDirty(startx, starty, endx - 1, endy - 1);
         if (detail > 1) {
-            skeleton.drawmodel.textureptr.bind();
-            DoMipmaps();
+            queueSkinUpload();
         }
 
         if (skeleton.free) {
@@ -5084,7 +5194,7 @@ void Person::DoStuff()
         if (bloodtoggle && !bled) {
             terrain.MakeDecal(blooddecalslow, headpoint, .8, .5, 0);
             for (unsigned int l = 0; l < terrain.patchobjects[whichpatchx][whichpatchz].size(); l++) {
-                unsigned int j = terrain.patchobjects[whichpatchx][whichpatchz][l];
+                unsigned int j = terrain.patchObject(whichpatchx, whichpatchz, l);
                 XYZ point = DoRotation(headpoint - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
                 float size = .8;
                 float opacity = .6;
@@ -5306,7 +5416,7 @@ void Person::DoStuff()
                     if (bloodtoggle && !bled) {
                         terrain.MakeDecal(blooddecal, headpoint, .2 * 1.2, .5, 0);
                         for (unsigned int l = 0; l < terrain.patchobjects[whichpatchx][whichpatchz].size(); l++) {
-                            unsigned int j = terrain.patchobjects[whichpatchx][whichpatchz][l];
+                            unsigned int j = terrain.patchObject(whichpatchx, whichpatchz, l);
                             XYZ point = DoRotation(headpoint - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
                             float size = .2 * 1.2;
                             float opacity = .6;
@@ -5325,7 +5435,7 @@ void Person::DoStuff()
                     if (bloodtoggle && !bled) {
                         terrain.MakeDecal(blooddecalslow, headpoint, .8, .5, 0);
                         for (unsigned int l = 0; l < terrain.patchobjects[whichpatchx][whichpatchz].size(); l++) {
-                            unsigned int j = terrain.patchobjects[whichpatchx][whichpatchz][l];
+                            unsigned int j = terrain.patchObject(whichpatchx, whichpatchz, l);
                             XYZ point = DoRotation(headpoint - Object::objects[j]->position, 0, -Object::objects[j]->yaw, 0);
                             float size = .8;
                             float opacity = .6;
@@ -6364,6 +6474,26 @@ void Person::PreUpdateSkeleton(){
 
 }
 
+/* the body parts a muscle belongs to each scale its vertices by their
+ * proportions, applied one after the other these simply add up */
+static XYZ muscleProportion(const Person& person, int p1, int p2)
+{
+    XYZ prop;
+    if (p1 == abdomen || p2 == abdomen) {
+        prop += person.getProportionXYZ(1);
+    }
+    if (p1 == lefthand || p1 == righthand || p1 == leftwrist || p1 == rightwrist || p1 == leftelbow || p1 == rightelbow || p2 == leftelbow || p2 == rightelbow) {
+        prop += person.getProportionXYZ(2);
+    }
+    if (p1 == leftfoot || p1 == rightfoot || p1 == leftankle || p1 == rightankle || p1 == leftknee || p1 == rightknee || p2 == leftknee || p2 == rightknee) {
+        prop += person.getProportionXYZ(3);
+    }
+    if (p1 == head || p2 == head) {
+        prop += person.getProportionXYZ(0);
+    }
+    return prop;
+}
+
 void Person::UpdateSkeleton()
 {
     MICROPROFILE_SCOPEI("Person", "UpdateSkeleton", 0x926329);
@@ -6438,6 +6568,11 @@ void Person::UpdateSkeleton()
 
         {MICROPROFILE_SCOPEI("Person", "reset-verts", 0x926329);
 
+        // skinning rewrites every vertex, collision checks fall back to a full scan
+        skeleton.drawmodel.invalidateBVH();
+        skeleton.drawmodellow.invalidateBVH();
+        skeleton.drawmodelclothes.invalidateBVH();
+
         int total_verts = skeleton.drawmodel.vertexNum;
         if(total_verts < skeleton.drawmodellow.vertexNum){
             total_verts = skeleton.drawmodellow.vertexNum;
@@ -6468,6 +6603,7 @@ void Person::UpdateSkeleton()
             // convenience renames
             const int p1 = skeleton.muscles[i].parent1->label;
             const int p2 = skeleton.muscles[i].parent2->label;
+            const XYZ prop = muscleProportion(*this, p1, p2);
 
             if ((skeleton.muscles[i].vertices.size() > 0 && playerdetail) || (skeleton.muscles[i].verticeslow.size() > 0 && !playerdetail)) {
                 morphness = 0;
@@ -6525,77 +6661,14 @@ void Person::UpdateSkeleton()
                 skeleton.muscles[i].lastrotate3 = skeleton.muscles[i].rotate3;
                 matrix4x4_rotate_y(mat, DEG_TO_RAD(-skeleton.muscles[i].lastrotate3));
 
+                SkinTransform xf;
+                xf.set(mat, prop, scale);
+
                 if (playerdetail || skeleton.free == 3) {
-                    for (unsigned j = 0; j < skeleton.muscles[i].vertices.size(); j++) {
-                        XYZ& v0 = skeleton.model[start].vertex[skeleton.muscles[i].vertices[j]];
-                        XYZ& v1 = skeleton.model[endthing].vertex[skeleton.muscles[i].vertices[j]];
-
-                        matrix4x4 mat2;
-                        matrix4x4_copy(mat2, mat);
-
-                        if (p1 == abdomen || p2 == abdomen) {
-                            matrix4x4_translate(mat2,
-                                (v0.x * (1 - morphness) + v1.x * morphness) * getProportionXYZ(1).x,
-                                (v0.y * (1 - morphness) + v1.y * morphness) * getProportionXYZ(1).y,
-                                (v0.z * (1 - morphness) + v1.z * morphness) * getProportionXYZ(1).z);
-                        }
-                        if (p1 == lefthand || p1 == righthand || p1 == leftwrist || p1 == rightwrist || p1 == leftelbow || p1 == rightelbow || p2 == leftelbow || p2 == rightelbow) {
-                            matrix4x4_translate(mat2,
-                                (v0.x * (1 - morphness) + v1.x * morphness) * getProportionXYZ(2).x,
-                                (v0.y * (1 - morphness) + v1.y * morphness) * getProportionXYZ(2).y,
-                                (v0.z * (1 - morphness) + v1.z * morphness) * getProportionXYZ(2).z);
-                        }
-                        if (p1 == leftfoot || p1 == rightfoot || p1 == leftankle || p1 == rightankle || p1 == leftknee || p1 == rightknee || p2 == leftknee || p2 == rightknee) {
-                            matrix4x4_translate(mat2,
-                                (v0.x * (1 - morphness) + v1.x * morphness) * getProportionXYZ(3).x,
-                                (v0.y * (1 - morphness) + v1.y * morphness) * getProportionXYZ(3).y,
-                                (v0.z * (1 - morphness) + v1.z * morphness) * getProportionXYZ(3).z);
-                        }
-                        if (p1 == head || p2 == head) {
-                            matrix4x4_translate(mat2,
-                                (v0.x * (1 - morphness) + v1.x * morphness) * getProportionXYZ(0).x,
-                                (v0.y * (1 - morphness) + v1.y * morphness) * getProportionXYZ(0).y,
-                                (v0.z * (1 - morphness) + v1.z * morphness) * getProportionXYZ(0).z);
-                        }
-                        skeleton.drawmodel.vertex[skeleton.muscles[i].vertices[j]].x = mat2[0][3] * scale;
-                        skeleton.drawmodel.vertex[skeleton.muscles[i].vertices[j]].y = mat2[1][3] * scale;
-                        skeleton.drawmodel.vertex[skeleton.muscles[i].vertices[j]].z = mat2[2][3] * scale;
-                    }
+                    skeleton.meshes->skin.skin(i, xf, start, endthing, morphness, skeleton.drawmodel.vertex);
                 }
                 if (!playerdetail || skeleton.free == 3) {
-                    for (unsigned j = 0; j < skeleton.muscles[i].verticeslow.size(); j++) {
-                        XYZ& v0 = skeleton.modellow.vertex[skeleton.muscles[i].verticeslow[j]];
-                        matrix4x4 mat2;
-                        matrix4x4_copy(mat2, mat);
-
-                        if (p1 == abdomen || p2 == abdomen) {
-                            matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(1).x,
-                                v0.y * getProportionXYZ(1).y,
-                                v0.z * getProportionXYZ(1).z);
-                        }
-                        if (p1 == lefthand || p1 == righthand || p1 == leftwrist || p1 == rightwrist || p1 == leftelbow || p1 == rightelbow || p2 == leftelbow || p2 == rightelbow) {
-                            matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(2).x,
-                                v0.y * getProportionXYZ(2).y,
-                                v0.z * getProportionXYZ(2).z);
-                        }
-                        if (p1 == leftfoot || p1 == rightfoot || p1 == leftankle || p1 == rightankle || p1 == leftknee || p1 == rightknee || p2 == leftknee || p2 == rightknee) {
-                            matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(3).x,
-                                v0.y * getProportionXYZ(3).y,
-                                v0.z * getProportionXYZ(3).z);
-                        }
-                        if (p1 == head || p2 == head) {
-                            matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(0).x,
-                                v0.y * getProportionXYZ(0).y,
-                                v0.z * getProportionXYZ(0).z);
-                        }
-                        skeleton.drawmodellow.vertex[skeleton.muscles[i].verticeslow[j]].x = mat2[0][3] * scale;
-                        skeleton.drawmodellow.vertex[skeleton.muscles[i].verticeslow[j]].y = mat2[1][3] * scale;
-                        skeleton.drawmodellow.vertex[skeleton.muscles[i].verticeslow[j]].z = mat2[2][3] * scale;
-                    }
+                    skeleton.meshes->skinlow.skin(i, xf, skeleton.drawmodellow.vertex);
                 }
             }
             if (skeleton.clothes && skeleton.muscles[i].verticesclothes.size() > 0) {
@@ -6621,40 +6694,10 @@ void Person::UpdateSkeleton()
                 skeleton.muscles[i].lastrotate3 = skeleton.muscles[i].rotate3;
                 matrix4x4_rotate_y(mat, DEG_TO_RAD(-skeleton.muscles[i].lastrotate3));
 
-                for (unsigned j = 0; j < skeleton.muscles[i].verticesclothes.size(); j++) {
-                    XYZ& v0 = skeleton.modelclothes.vertex[skeleton.muscles[i].verticesclothes[j]];
-                    
-                    matrix4x4 mat2;
-                    matrix4x4_copy(mat2, mat);
-
-                    if (p1 == abdomen || p2 == abdomen) {
-                        matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(1).x,
-                                v0.y * getProportionXYZ(1).y,
-                                v0.z * getProportionXYZ(1).z);
-                    }
-                    if (p1 == lefthand || p1 == righthand || p1 == leftwrist || p1 == rightwrist || p1 == leftelbow || p1 == rightelbow || p2 == leftelbow || p2 == rightelbow) {
-                        matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(2).x,
-                                v0.y * getProportionXYZ(2).y,
-                                v0.z * getProportionXYZ(2).z);
-                    }
-                    if (p1 == leftfoot || p1 == rightfoot || p1 == leftankle || p1 == rightankle || p1 == leftknee || p1 == rightknee || p2 == leftknee || p2 == rightknee) {
-                        matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(3).x,
-                                v0.y * getProportionXYZ(3).y,
-                                v0.z * getProportionXYZ(3).z);
-                    }
-                    if (p1 == head || p2 == head) {
-                        matrix4x4_translate(mat2,
-                                v0.x * getProportionXYZ(0).x,
-                                v0.y * getProportionXYZ(0).y,
-                                v0.z * getProportionXYZ(0).z);
-                    }
-                    skeleton.drawmodelclothes.vertex[skeleton.muscles[i].verticesclothes[j]].x = mat2[0][3] * scale;
-                    skeleton.drawmodelclothes.vertex[skeleton.muscles[i].verticesclothes[j]].y = mat2[1][3] * scale;
-                    skeleton.drawmodelclothes.vertex[skeleton.muscles[i].verticesclothes[j]].z = mat2[2][3] * scale;
-                }
+                SkinTransform xf;
+                xf.set(mat, prop, scale);
+
+                skeleton.meshes->skinclothes.skin(i, xf, skeleton.drawmodelclothes.vertex);
             }
             updatedelay = 1 + (float)(Random() % 100) / 1000;
         }
@@ -6676,48 +6719,43 @@ void Person::UpdateSkeleton()
     }
 }
 
-#define _dophase_calcnormals(model) \
-    switch(phase){\
-        default: case 1: model.submitCalculateNormalsJobs_Phase1(false, p1dep, out); break;\
-        case 2: model.submitCalculateNormalsJobs_Phase2(out); break;\
-        case 3: model.submitCalculateNormalsJobs_Phase3(1, out); break;\
-    }
-
+/**
+ * Job version of UpdateNormals, every job runs after `dep` (the skeleton
+ * update) and is appended to `out`
+ * */
 void Person::submitCalculateNormalsJobs(
-    int phase,
-    WorkerThread::JobHandle p1dep,
+    WorkerThread::JobHandle dep,
     std::vector<WorkerThread::JobHandle> &out
 ){
     if (skeleton.free != 2 && (skeleton.free == 1 || skeleton.free == 3 || id == 0 || (normalsupdatedelay <= 0) || animTarget == getupfromfrontanim || animTarget == getupfrombackanim || animCurrent == getupfromfrontanim || animCurrent == getupfrombackanim)) {
         normalsupdatedelay = 1;
         if (playerdetail || skeleton.free == 3) {
             //skeleton.drawmodel.CalculateNormals(0);
-            _dophase_calcnormals(skeleton.drawmodel);
+            skeleton.drawmodel.submitCalculateNormalsJobs(false, 0, dep, out);
         }
         if (!playerdetail || skeleton.free == 3) {
             //skeleton.drawmodellow.CalculateNormals(0);
-            _dophase_calcnormals(skeleton.drawmodellow);
+            skeleton.drawmodellow.submitCalculateNormalsJobs(false, 0, dep, out);
         }
         if (skeleton.clothes) {
             //skeleton.drawmodelclothes.CalculateNormals(0);
-            _dophase_calcnormals(skeleton.drawmodelclothes);
+            skeleton.drawmodelclothes.submitCalculateNormalsJobs(false, 0, dep, out);
         }
-    } else if(phase == 3) {
+    } else {
         if (playerdetail || skeleton.free == 3) {
             //skeleton.drawmodel.UpdateVertexArrayNoTexNoNorm();
-            skeleton.drawmodel.submitCalculateNormalsJobs_Phase3(1, out);
+            skeleton.drawmodel.submitUpdateVertexArrayJobs(1, dep, out);
         }
         if (!playerdetail || skeleton.free == 3) {
             //skeleton.drawmodellow.UpdateVertexArrayNoTexNoNorm();
-            skeleton.drawmodellow.submitCalculateNormalsJobs_Phase3(1, out);
+            skeleton.drawmodellow.submitUpdateVertexArrayJobs(1, dep, out);
         }
         if (skeleton.clothes) {
             //skeleton.drawmodelclothes.UpdateVertexArrayNoTexNoNorm();
-            skeleton.drawmodelclothes.submitCalculateNormalsJobs_Phase3(1, out);
+            skeleton.drawmodelclothes.submitUpdateVertexArrayJobs(1, dep, out);
         }
     }
 }
-#undef _dophase_calcnormals
 
 bool Person::UpdateNormals(){
     MICROPROFILE_SCOPEI("Person", "UpdateNormals", 0x926329);
@@ -6753,6 +6791,18 @@ bool Person::UpdateNormals(){
     return did_update;
 }
 
+/* frames are drawn between two simulation ticks, this moves the person
+ * back from coords towards where the last tick started */
+XYZ Person::drawOffset()
+{
+    XYZ delta;
+    // teleports and respawns snap
+    if (distsq(&tickcoords, &coords) < 4) {
+        delta = (tickcoords - coords) * (1 - tickalpha);
+    }
+    return delta;
+}
+
 /* EFFECT
  * MONSTER
  * TODO: ???
@@ -6770,6 +6820,9 @@ int Person::DrawSkeleton()
 
     //UpdateSkeleton();
 
+    // blood painted since the last draw, possibly from a sprite job
+    updateSkinTexture();
+
     framemult = .01;
     updatedelaychange = -framemult * 4 * (45 - findDistance(&viewer, &coords) * 1);
     if (updatedelaychange > -realmultiplier * 30) {
@@ -6786,9 +6839,11 @@ int Person::DrawSkeleton()
     }
     updatedelay += updatedelaychange;
 
+    XYZ drawcoords = coords + drawOffset();
+
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
-    glTranslatef(coords.x, coords.y - .02, coords.z);
+    glTranslatef(drawcoords.x, drawcoords.y - .02, drawcoords.z);
     if (!skeleton.free) {
         glTranslatef(offset.x * scale, offset.y * scale, offset.z * scale);
         glRotatef(yaw, 0, 1, 0);
@@ -7430,9 +7485,11 @@ struct PersonApplyClothesJob: WorkerThread::Job {
         //--
     }
     void execute() override {
+        std::vector<const ImageRec*> textures;
         for(size_t i = 0; i < person->clothes.size(); i++){
-            person->addClothes(i, (*imgcache)[person->clothes[i]]);
+            textures.push_back((*imgcache)[person->clothes[i]]);
         }
+        person->compositeClothes(textures);
         person->DoMipmaps();
     }
 };
@@ -7444,9 +7501,7 @@ WorkerThread::JobHandle Person::submitApplyClothesJob(std::map<std::string, Imag
 void Person::addClothes(std::vector<ImageRec*> &textures)
 {
     ASSERT(clothes.size() == textures.size());
-    for(size_t i = 0; i < clothes.size(); i++){
-        addClothes(i, textures[i]);
-    }
+    compositeClothes(std::vector<const ImageRec*>(textures.begin(), textures.end()));
     DoMipmaps();
 }
 
@@ -7454,13 +7509,37 @@ void Person::addClothes()
 {
     MICROPROFILE_SCOPEI("Person", "addClothes", 0xaaffaa);
     if (clothes.size() > 0) {
-
-        for (unsigned i = 0; i < clothes.size(); i++) {
-            addClothes(i, nullptr);
-        }
+        // null textures are loaded from disk by addClothes(int), only on a cache miss
+        compositeClothes(std::vector<const ImageRec*>(clothes.size(), nullptr));
         DoMipmaps();
     }}
 
+/* puts on the whole outfit, or copies it from a person who already wears
+ * the same clothes over the same skin */
+void Person::compositeClothes(const std::vector<const ImageRec*>& textures)
+{
+    MICROPROFILE_SCOPEI("Person", "compositeClothes", 0xaaffaa);
+    ASSERT(textures.size() == clothes.size());
+    int bytes = skeleton.skinsize * skeleton.skinsize * 3;
+    if (bytes <= 0 || clothes.empty()) {
+        return;
+    }
+
+    GLubyte* array = &skeleton.skinText[0];
+    std::string key = ClothesCompositor::cacheKey(array, bytes, clothes, clothestintr, clothestintg, clothestintb);
+    if (ClothesCompositor::findCached(key, array, bytes)) {
+        return;
+    }
+
+    bool complete = true;
+    for (unsigned i = 0; i < clothes.size(); i++) {
+        complete = addClothes(i, textures[i]) && complete;
+    }
+    if (complete) {
+        ClothesCompositor::addCached(key, array, bytes);
+    }
+}
+
 bool Person::addClothes(const int& clothesId, const ImageRec *texture)
 {
     LOGFUNC;
@@ -7476,7 +7555,6 @@ bool Person::addClothes(const int& clothesId, const ImageRec *texture)
         opened = true;
     }
 
-    float alphanum;
     //Is it valid?
     if (opened) {
         float tintr = clothestintr[clothesId];
@@ -7521,30 +7599,8 @@ bool Person::addClothes(const int& clothesId, const ImageRec *texture)
             bytesPerPixel = texture->info.img.bpp / 8;
         }
 
-        int tempnum = 0;
-        alphanum = 255;
-        for (int i = 0; i < (int)(sizeY * sizeX * bytesPerPixel); i++) {
-            uint8_t col = texture->data[i];
-
-            if (bytesPerPixel == 3) {
-                alphanum = 255;
-            } else if ((i + 1) % 4 == 0) {
-                alphanum = col;
-            }
-            if ((i + 1) % 4 || bytesPerPixel == 3) {
-                if ((i % 4) == 0) {
-                    col *= tintr;
-                }
-                if ((i % 4) == 1) {
-                    col *= tintg;
-                }
-                if ((i % 4) == 2) {
-                    col *= tintb;
-                }
-                array[tempnum] = (float)array[tempnum] * (1 - alphanum / 255) + (float)col * (alphanum / 255);
-                tempnum++;
-            }
-        }
+        const float tint[3] = { tintr, tintg, tintb };
+        ClothesCompositor::blend(array, texture->data, sizeX * sizeY, bytesPerPixel, tint);
         return 1;
     } else {
         LOG("Person::addClothes(%d) FAILED TO OPEN: '%s'", (int)clothesId, fname.c_str());
@@ -8721,6 +8777,7 @@ Person::Person(Json::Value value, int /*mapvers*/, unsigned i)
 
     oldcoords = coords;
     realoldcoords = coords;
+    tickcoords = coords;
 }
 
 Person::operator Json::Value() {
@@ -27,6 +27,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Graphic/Models.hpp"
 #include "Graphic/Sprite.hpp"
 #include "Graphic/gamegl.hpp"
+#include "Math/SpatialGrid.hpp"
 #include "Math/XYZ.hpp"
 #include "Objects/PersonType.hpp"
 #include "Objects/Weapons.hpp"
@@ -62,6 +63,10 @@ private:
 public:
     static std::vector<std::shared_ptr<Person>> players;
 
+    /* broad-phase over the players' coords, ids are indices into players */
+    static SpatialGrid grid;
+    static void updateGrid();
+
 
     ////
     float updatedelaychange;
@@ -111,6 +116,7 @@ public:
     XYZ realoldcoords;
     XYZ oldcoords;
     XYZ coords;
+    XYZ tickcoords; // coords before the last simulation tick
     XYZ velocity;
 
     float unconscioustime;
@@ -164,6 +170,11 @@ public:
     int direction;
     float texupdatedelay;
 
+    /* rows and columns of skinText painted since the last upload, empty while first > last */
+    int skinDirtyFirstRow, skinDirtyLastRow;
+    int skinDirtyFirstCol, skinDirtyLastCol;
+    bool skinUploadQueued; // the next DrawSkeleton uploads the dirty rows
+
     float headyaw, headpitch;
     float targetheadyaw, targetheadpitch;
 
@@ -402,12 +413,19 @@ public:
         //VITAGL: TODO
         //glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, skeleton.skinsize, skeleton.skinsize, 0, GL_RGB, GL_UNSIGNED_BYTE, &skeleton.skinText[0]);
+        skinDirtyFirstRow = skinDirtyFirstCol = SKINTEX_SQSIZE;
+        skinDirtyLastRow = skinDirtyLastCol = -1;
+        skinUploadQueued = false;
     }
+    void markSkinDirty(int firstrow, int firstcol, int lastrow, int lastcol);
+    void queueSkinUpload();
+    void updateSkinTexture();
 
     int SphereCheck(XYZ* p1, float radius, XYZ* p, XYZ* move, float* rotate, Model* model);
     
     bool isVisible();
     int DrawSkeleton();
+    XYZ drawOffset();
         void PreUpdateSkeleton();
         void UpdateSkeleton();
         bool UpdateNormals();
@@ -427,8 +445,9 @@ public:
     void submitLoadClothesJobs(std::vector<WorkerThread::JobHandle> &out, std::vector<ImageRec*> &tex_out);
     WorkerThread::JobHandle submitApplyClothesJob(std::map<std::string, ImageRec*> *imgcache);
     void addClothes(std::vector<ImageRec*> &textures);
+    void compositeClothes(const std::vector<const ImageRec*>& textures);
 
-    void submitCalculateNormalsJobs(int phase, WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out);
+    void submitCalculateNormalsJobs(WorkerThread::JobHandle dep, std::vector<WorkerThread::JobHandle> &out);
 
     void doAI();
 
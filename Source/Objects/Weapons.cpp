@@ -42,6 +42,7 @@ extern XYZ viewer;
 extern float realmultiplier;
 extern int slomo;
 extern float slomodelay;
+extern float tickalpha;
 extern bool cellophane;
 extern float texdetail;
 extern int bloodtoggle;
@@ -77,6 +78,7 @@ Weapon::Weapon(int t, int o)
     flamedelay = 0;
     damage = 0;
     position = -1000;
+    tickposition = -1000;
     tippoint = -1000;
 }
 
@@ -270,11 +272,11 @@ void Weapon::doStuff(int i)
     if (owner == -1 && (velocity.x || velocity.y || velocity.z) && !physics) { // if the weapon is flying
         position += velocity * multiplier;
         tippoint += velocity * multiplier;
-        whichpatchx = position.x / (terrain.size / subdivision * terrain.scale);
-        whichpatchz = position.z / (terrain.size / subdivision * terrain.scale);
-        if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < subdivision && whichpatchz < subdivision) {
+        whichpatchx = position.x / (terrain.size / terrain.subdivision * terrain.scale);
+        whichpatchz = position.z / (terrain.size / terrain.subdivision * terrain.scale);
+        if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < terrain.subdivision && whichpatchz < terrain.subdivision) {
             for (unsigned int j = 0; j < terrain.patchobjects[whichpatchx][whichpatchz].size(); j++) { // check for collision
-                unsigned int k = terrain.patchobjects[whichpatchx][whichpatchz][j];
+                unsigned int k = terrain.patchObject(whichpatchx, whichpatchz, j);
                 start = oldtippoint;
                 end = tippoint;
                 whichhit = Object::objects[k]->model.LineCheck(&start, &end, &colpoint, &Object::objects[k]->position, &Object::objects[k]->yaw);
@@ -330,7 +332,10 @@ void Weapon::doStuff(int i)
         }
 
         if (velocity.x || velocity.y || velocity.z) {
-            for (unsigned j = 0; j < Person::players.size(); j++) {
+            static std::vector<unsigned> nearby;
+            Person::grid.query(position, 2, nearby);
+            for (unsigned n = 0; n < nearby.size(); n++) {
+                const unsigned j = nearby[n];
                 footvel = 0;
                 footpoint = DoRotation((Person::players[j]->jointPos(abdomen) + Person::players[j]->jointPos(neck)) / 2, 0, Person::players[j]->yaw, 0) * Person::players[j]->scale + Person::players[j]->coords;
                 if (owner == -1 && distsqflat(&position, &Person::players[j]->coords) < 1.5 &&
@@ -403,6 +408,8 @@ void Weapon::doStuff(int i)
                     } else {
                         missed = 1;
                     }
+                    // RagDoll() may have moved them
+                    Person::grid.move(j, Person::players[j]->coords);
                 }
             }
         }
@@ -529,11 +536,11 @@ void Weapon::doStuff(int i)
             tippoint = newpoint2;
 
             //Object collisions
-            whichpatchx = (position.x) / (terrain.size / subdivision * terrain.scale);
-            whichpatchz = (position.z) / (terrain.size / subdivision * terrain.scale);
-            if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < subdivision && whichpatchz < subdivision) {
+            whichpatchx = (position.x) / (terrain.size / terrain.subdivision * terrain.scale);
+            whichpatchz = (position.z) / (terrain.size / terrain.subdivision * terrain.scale);
+            if (whichpatchx > 0 && whichpatchz > 0 && whichpatchx < terrain.subdivision && whichpatchz < terrain.subdivision) {
                 for (unsigned int j = 0; j < terrain.patchobjects[whichpatchx][whichpatchz].size(); j++) {
-                    unsigned int k = terrain.patchobjects[whichpatchx][whichpatchz][j];
+                    unsigned int k = terrain.patchObject(whichpatchx, whichpatchz, j);
 
                     if (firstfree) {
                         if (type == staff) {
@@ -1078,6 +1085,9 @@ void Weapon::doStuff(int i)
 
 void Weapons::DoStuff()
 {
+    // players have moved since the last tick
+    Person::updateGrid();
+
     //Move
     int i = 0;
     for (std::vector<Weapon>::iterator weapon = begin(); weapon != end(); ++weapon) {
@@ -1085,6 +1095,17 @@ void Weapons::DoStuff()
     }
 }
 
+/* thrown and dropped weapons are drawn between the last two ticks too,
+ * held ones follow their owner, see Person::drawOffset */
+XYZ Weapon::drawOffset()
+{
+    XYZ delta;
+    if (distsq(&tickposition, &position) < 4) {
+        delta = (tickposition - position) * (1 - tickalpha);
+    }
+    return delta;
+}
+
 void Weapon::draw()
 {
     static XYZ terrainlight;
@@ -1139,6 +1160,12 @@ void Weapon::draw()
             }
         }
         if (draw) {
+            XYZ drawoffset;
+            if (owner != -1) {
+                drawoffset = Person::players[owner]->drawOffset();
+            } else {
+                drawoffset = drawOffset();
+            }
             terrainlight = terrain.getLighting(position.x, position.z);
             if (drawhowmany > 0) {
                 glAlphaFunc(GL_GREATER, 0.01);
@@ -1147,6 +1174,7 @@ void Weapon::draw()
                 glMatrixMode(GL_MODELVIEW);
                 glPushMatrix();
                 glColor4f(terrainlight.x, terrainlight.y, terrainlight.z, j / drawhowmany);
+                glTranslatef(drawoffset.x, drawoffset.y, drawoffset.z);
                 if (owner == -1) {
                     glTranslatef(position.x * (((float)(j)) / drawhowmany) + lastdrawnposition.x * (1 - ((float)(j)) / drawhowmany), position.y * (((float)(j)) / drawhowmany) + lastdrawnposition.y * (1 - ((float)(j)) / drawhowmany), position.z * (((float)(j)) / drawhowmany) + lastdrawnposition.z * (1 - ((float)(j)) / drawhowmany));
                 } else {
@@ -1280,5 +1308,14 @@ int Weapons::Draw()
 }
 
 Weapons::Weapons()
+    : grid(2)
+{
+}
+
+void Weapons::updateGrid()
 {
+    grid.clear();
+    for (unsigned i = 0; i < size(); i++) {
+        grid.insert(i, (*this)[i].position);
+    }
 }
@@ -27,6 +27,7 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Graphic/Sprite.hpp"
 #include "Graphic/Texture.hpp"
 #include "Graphic/gamegl.hpp"
+#include "Math/SpatialGrid.hpp"
 #include "Math/XYZ.hpp"
 #include "Objects/Person.hpp"
 
@@ -45,6 +46,7 @@ public:
 
     void draw();
     void doStuff(int);
+    XYZ drawOffset();
 
     int getType()
     {
@@ -57,6 +59,7 @@ public:
 
     int owner;
     XYZ position;
+    XYZ tickposition; // position before the last simulation tick
     XYZ tippoint;
     XYZ velocity;
     XYZ tipvelocity;
@@ -126,6 +129,10 @@ public:
 
     int Draw();
     void DoStuff();
+
+    /* broad-phase over the weapons' positions, ids are indices */
+    SpatialGrid grid;
+    void updateGrid();
 };
 
 extern Weapons weapons;
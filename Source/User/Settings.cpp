@@ -39,6 +39,8 @@ void DefaultSettings()
     detail = 2;
     usermousesensitivity = 1;
     phys_quality = 1;
+    workerthreads = 0;
+    pinthreads = 0;
     newscreenwidth = kContextWidth = 960;
     newscreenheight = kContextHeight = 544;
     fullscreen = 0;
@@ -110,6 +112,10 @@ void SaveSettings()
     opstream << usermousesensitivity;
     opstream << "\nSimulation Quality:\n";
     opstream << phys_quality;
+    opstream << "\nWorker threads (0 = one per core):\n";
+    opstream << workerthreads;
+    opstream << "\nPin threads:\n";
+    opstream << pinthreads;
     opstream << "\nBlur(0,1):\n";
     opstream << ismotionblur;
     opstream << "\nOverall Detail(0,1,2) higher=better:\n";
@@ -229,6 +235,10 @@ bool LoadSettings()
             ipstream >> usermousesensitivity;
         } else if (!strncmp(setting, "Simulation Quality", 18)) {
             ipstream >> phys_quality;
+        } else if (!strncmp(setting, "Worker threads", 14)) {
+            ipstream >> workerthreads;
+        } else if (!strncmp(setting, "Pin threads", 11)) {
+            ipstream >> pinthreads;
         } else if (!strncmp(setting, "Blur", 4)) {
             ipstream >> ismotionblur;
         } else if (!strncmp(setting, "Overall Detail", 14)) {
@@ -24,6 +24,8 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Game.hpp"
 
 extern int phys_quality;
+extern int workerthreads;
+extern bool pinthreads;
 extern float usermousesensitivity;
 extern bool ismotionblur;
 extern bool floatjump;
@@ -22,12 +22,91 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Utils/Log.h"
 #include "SDL2.h"
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "Thirdparty/microprofile/microprofile.h"
 
 bool keyDown[SDL_NUM_SCANCODES + 6];
 bool keyPressed[SDL_NUM_SCANCODES + 6];
 
+/*
+Input streams are plain text, one record per line after the header:
+	f <deltah> <deltav>                 once per frame, from Input::beginFrame
+	k <mask> <analog_lh> <analog_lv>    once per Input::Tick
+mask holds keyDown[] of streamKeys[] in order. Floats are written with %a so
+a replay gets them back bit for bit. When a replay runs a different number of
+ticks per frame than the recording, surplus 'k' records are dropped at the
+next 'f' and missing ones repeat the last key state.
+*/
+#define INPUT_STREAM_HEADER "lugaru-input 1"
+
+static FILE *recordFile = nullptr;
+static FILE *replayFile = nullptr;
+static bool replaying = false;
+
+struct StreamRecord{
+	char tag; //0 once the replay is exhausted
+	unsigned mask;
+	float a, b;
+};
+static StreamRecord pending;
+
+static unsigned short *const streamKeys[] = {
+	&Game::leftkey, &Game::rightkey, &Game::forwardkey, &Game::backkey,
+	&Game::jumpkey, &Game::crouchkey, &Game::drawkey, &Game::attackkey,
+	&Game::throwkey, &Game::dodgekey, &Game::startkey, &Game::selectkey
+};
+static const int numStreamKeys = sizeof(streamKeys) / sizeof(streamKeys[0]);
+
+static void readRecord(){
+	pending.tag = 0;
+	if(replayFile == nullptr){
+		return;
+	}
+
+	char tag;
+	if(fscanf(replayFile, " %c", &tag) != 1){
+		return;
+	}
+	if(tag == 'f' && fscanf(replayFile, "%a %a", &pending.a, &pending.b) == 2){
+		pending.tag = tag;
+	}else if(tag == 'k' && fscanf(replayFile, "%x %a %a", &pending.mask, &pending.a, &pending.b) == 3){
+		pending.tag = tag;
+	}else{
+		LOG("Malformed input replay record '%c', stopping replay", tag);
+	}
+}
+
+static void replayTick(){
+	for(int i = 0; i < numStreamKeys; i++){
+		keyPressed[*streamKeys[i]] = false;
+	}
+	if(pending.tag != 'k'){
+		return;
+	}
+
+	for(int i = 0; i < numStreamKeys; i++){
+		int k = *streamKeys[i];
+		bool st = (pending.mask >> i) & 1;
+		keyPressed[k] = !keyDown[k] && st;
+		keyDown[k] = st;
+	}
+	Game::analog_lh = pending.a;
+	Game::analog_lv = pending.b;
+	readRecord();
+}
+
+static void recordTick(){
+	unsigned mask = 0;
+	for(int i = 0; i < numStreamKeys; i++){
+		if(keyDown[*streamKeys[i]]){
+			mask |= 1u << i;
+		}
+	}
+	fprintf(recordFile, "k %x %a %a\n", mask, Game::analog_lh, Game::analog_lv);
+}
+
 
 static SDL_GameController *getController(){
 	static SDL_GameController *_controller = nullptr;
@@ -44,6 +123,10 @@ static SDL_GameController *getController(){
 void Input::Tick()
 {
 	SDL_PumpEvents();
+	if(replaying){
+		replayTick();
+		return;
+	}
 #ifndef PLATFORM_VITA
 	int numkeys;
 	const Uint8* keyState = SDL_GetKeyboardState(&numkeys);
@@ -101,6 +184,10 @@ void Input::Tick()
 		keyDown[Game::backkey] = false;
 	}
 
+	if(recordFile != nullptr){
+		recordTick();
+	}
+
     #if MICROPROFILE_ENABLED
     static int mpst = 0;
 
@@ -183,3 +270,90 @@ bool Input::MouseClicked()
 {
 	return isKeyPressed(MOUSEBUTTON_LEFT);
 }
+
+bool Input::startRecording(const char *path)
+{
+	ASSERT(recordFile == nullptr && !replaying);
+	recordFile = fopen(path, "w");
+	if(recordFile == nullptr){
+		LOG("Failed to open input recording %s", path);
+		return false;
+	}
+	fprintf(recordFile, INPUT_STREAM_HEADER "\n");
+	return true;
+}
+
+bool Input::startReplay(const char *path)
+{
+	ASSERT(recordFile == nullptr && !replaying);
+	for(int i = 0; i < numStreamKeys; i++){
+		keyDown[*streamKeys[i]] = false;
+	}
+	pending.tag = 0;
+
+	//no file replays an empty stream, so nothing ever touches the controller
+	if(path == nullptr){
+		replaying = true;
+		return true;
+	}
+
+	replayFile = fopen(path, "r");
+	if(replayFile == nullptr){
+		LOG("Failed to open input replay %s", path);
+		return false;
+	}
+
+	char header[32];
+	if(fgets(header, sizeof(header), replayFile) == nullptr
+		|| strncmp(header, INPUT_STREAM_HEADER, strlen(INPUT_STREAM_HEADER)) != 0){
+		LOG("%s is not an input recording", path);
+		fclose(replayFile);
+		replayFile = nullptr;
+		return false;
+	}
+
+	replaying = true;
+	readRecord();
+	return true;
+}
+
+void Input::stopStreams()
+{
+	if(recordFile != nullptr){
+		fclose(recordFile);
+		recordFile = nullptr;
+	}
+	if(replayFile != nullptr){
+		fclose(replayFile);
+		replayFile = nullptr;
+	}
+	replaying = false;
+	pending.tag = 0;
+}
+
+bool Input::isReplaying()
+{
+	return replaying;
+}
+
+void Input::beginFrame()
+{
+	if(recordFile != nullptr){
+		fprintf(recordFile, "f %a %a\n", Game::deltah, Game::deltav);
+	}
+	if(!replaying){
+		return;
+	}
+
+	while(pending.tag == 'k'){
+		readRecord();
+	}
+	if(pending.tag == 'f'){
+		Game::deltah = pending.a;
+		Game::deltav = pending.b;
+		readRecord();
+	}else{
+		Game::deltah = 0;
+		Game::deltav = 0;
+	}
+}
@@ -41,6 +41,13 @@ public:
     static bool isKeyPressed(int k);
     static const char* keyToChar(unsigned short which);
     static bool MouseClicked();
+
+    /* per-frame input streams, see Input.cpp for the file format */
+    static bool startRecording(const char* path);
+    static bool startReplay(const char* path);
+    static void stopStreams();
+    static bool isReplaying();
+    static void beginFrame();
 };
 
 #endif
@@ -7,13 +7,21 @@
 
 #include <vector>
 #include <stdarg.h>
+#include <stdint.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <string.h>
 #include <errno.h>
 
 #include <SDL2/SDL.h>
 
+#if PLATFORM_VITA
+	#include <psp2/kernel/threadmgr.h>
+	//cores the system lets applications run on
+	#define VITA_USER_CORES 3
+#elif defined(__linux__)
+	#include <sched.h>
+#endif
+
 #ifndef NDEBUG
 	#define PTCHK0(c, m) if(c){ASSERT(!(m));}
 #else
@@ -22,33 +30,207 @@
 
 extern XYZ viewer;
 
+thread_local bool jobRandomActive = false;
+thread_local unsigned jobRandomState = 0;
+
 namespace WorkerThread {
 
-#define MAX_JOBS 100
+//max number of live (submitted but not yet joined) jobs. Must be a power of two
+#define MAX_JOBS 1024
+
+/**
+ * Bounded multi-producer/multi-consumer queue (Dmitry Vyukov's design).
+ *
+ * Used both as the shared ready queue for jobs submitted from threads that
+ * aren't workers, and as the free-list of job handles.
+ * */
+template<typename T, size_t N>
+struct MPMCQueue {
+	static_assert((N & (N - 1)) == 0, "MPMCQueue size must be a power of two");
+
+	struct Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	Cell cells[N];
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+
+	void init(){
+		for(size_t i = 0; i < N; i++){
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+	}
+
+	bool push(const T &val){
+		size_t pos = tail.load(std::memory_order_relaxed);
+		for(;;){
+			Cell &cell = cells[pos & (N - 1)];
+			size_t seq = cell.seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if(dif == 0){
+				if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					cell.data = val;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}else if(dif < 0){
+				//full
+				return false;
+			}else{
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(T &out){
+		size_t pos = head.load(std::memory_order_relaxed);
+		for(;;){
+			Cell &cell = cells[pos & (N - 1)];
+			size_t seq = cell.seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+			if(dif == 0){
+				if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					out = cell.data;
+					cell.seq.store(pos + N, std::memory_order_release);
+					return true;
+				}
+			}else if(dif < 0){
+				//empty
+				return false;
+			}else{
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+/**
+ * Chase-Lev work-stealing deque, one per worker.
+ *
+ * Only the owning worker may push() and pop() (LIFO end), any thread may
+ * steal() (FIFO end). The buffer never grows: there can never be more than
+ * MAX_JOBS live jobs, so it can never overflow either.
+ * */
+struct WorkDeque {
+	std::atomic<Job*> buffer[MAX_JOBS];
+	alignas(64) std::atomic<int64_t> top;
+	alignas(64) std::atomic<int64_t> bottom;
+
+	void init(){
+		for(int i = 0; i < MAX_JOBS; i++){
+			buffer[i].store(nullptr, std::memory_order_relaxed);
+		}
+		top.store(0, std::memory_order_relaxed);
+		bottom.store(0, std::memory_order_relaxed);
+	}
+
+	void push(Job *job){
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		ASSERT(b - top.load(std::memory_order_acquire) < MAX_JOBS && "WorkDeque overflow");
+		buffer[b & (MAX_JOBS - 1)].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	Job *pop(){
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if(t > b){
+			//empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
 
+		Job *ret = buffer[b & (MAX_JOBS - 1)].load(std::memory_order_relaxed);
+		if(t == b){
+			//last item, race against thieves for it
+			if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+				ret = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return ret;
+	}
+
+	Job *steal(){
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+
+		if(t >= b){
+			return nullptr;
+		}
+
+		Job *ret = buffer[t & (MAX_JOBS - 1)].load(std::memory_order_relaxed);
+		if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+			//lost the race against the owner or another thief
+			return nullptr;
+		}
+		return ret;
+	}
+};
+
+/**
+ * Per-handle bookkeeping. The mutex/condition pair is only used by
+ * threads that block in join(), the spinlock guards the job's dependents.
+ * */
 struct JobSync {
 	pthread_mutex_t mtx;
 	pthread_cond_t cnd;
+	std::atomic<int> waiters;
+	std::atomic<bool> depLock;
 
 	void init(){
 		PTCHK0(pthread_mutex_init(&mtx, NULL), "Failed to init mutex for JobSync");
 		PTCHK0(pthread_cond_init(&cnd, NULL), "Failed to init cond for JobSync");
+		waiters.store(0);
+		depLock.store(false);
+	}
+
+	void lockDeps(){
+		while(depLock.exchange(true, std::memory_order_acquire)){
+			//--
+		}
 	}
-	void destroy(){
-		PTCHK0(pthread_mutex_lock(&mtx), "failed lock JobSync's mutex");
-		PTCHK0(pthread_mutex_unlock(&mtx), "failed to unlock JobSync's mutex");
-		PTCHK0(pthread_mutex_destroy(&mtx), "JobSync utex destruction failed");
-		PTCHK0(pthread_cond_destroy(&cnd), "JobSync condition variable destruction failed");	
+
+	void unlockDeps(){
+		depLock.store(false, std::memory_order_release);
 	}
 };
 
 Job *jobs[MAX_JOBS];
 JobSync jobs_sync[MAX_JOBS];
-pthread_mutex_t mtxJobs;
 
-pthread_cond_t cndJobs;
-pthread_mutex_t mtxUnclaimed;
-int unclaimed_jobs = 0;
+//unused job handles
+MPMCQueue<JobHandle, MAX_JOBS> freeHandles;
+
+//ready jobs pushed by threads that don't own a WorkDeque (e.g. main thread)
+MPMCQueue<Job*, MAX_JOBS> readyQueue;
+
+WorkDeque workerDeques[MAX_WORKERS];
+std::atomic<int> numWorkers(0);
+
+//index into workerDeques for worker threads, -1 for everything else
+thread_local int workerIndex = -1;
+
+//number of jobs sitting in a ready queue which haven't been claimed yet
+std::atomic<int> readyJobs(0);
+
+std::atomic<bool> shuttingDown(false);
+
+//base and count for the seed handed to each submitted job
+std::atomic<unsigned> jobSeedBase(0);
+std::atomic<unsigned> jobsSubmitted(0);
+std::atomic<int> sleepingWorkers(0);
+pthread_mutex_t mtxIdle;
+pthread_cond_t cndIdle;
 
 //TODO: better allocation strategy for jobs (e.g. ring buffer)
 void *job_alloc(size_t size){
@@ -58,17 +240,12 @@ void job_free(void *ptr){
 	free(ptr);
 }
 
-JobState Job::getState(bool safe){
-	if(safe) PTCHK0(pthread_mutex_lock(&jobs_sync[handle].mtx), "Failed to lock job's mutex");
-	JobState ret = state;
-	if(safe) PTCHK0(pthread_mutex_unlock(&jobs_sync[handle].mtx), "Failed to unlock job's mutex");
-	return ret;
+JobState Job::getState(){
+	return state.load(std::memory_order_acquire);
 }
 
-void Job::setState(JobState set, bool safe){
-	if(safe) PTCHK0(pthread_mutex_lock(&jobs_sync[handle].mtx), "Failed to lock job's mutex");
-	state = set;
-	if(safe) PTCHK0(pthread_mutex_unlock(&jobs_sync[handle].mtx), "Failed to unlock job's mutex");
+void Job::setState(JobState set){
+	state.store(set, std::memory_order_release);
 }
 
 void destroy_job(JobHandle handle){
@@ -77,304 +254,415 @@ void destroy_job(JobHandle handle){
 	Job *j = jobs[handle];
 	ASSERT(j != nullptr && "Tried to destroy null job");
 
-	PTCHK0(pthread_mutex_lock(&jobs_sync[handle].mtx), "destroy_job failed lock job's mutex");
-	
-	job_free((void*)j);
 	jobs[handle] = nullptr;
+	j->~Job();
+	job_free((void*)j);
 
-	PTCHK0(pthread_mutex_unlock(&jobs_sync[handle].mtx), "destroy_job failed to unlock job's mutex");
+	bool ok = freeHandles.push(handle);
+	ASSERT(ok && "Job handle free-list overflow");
+	(void)ok;
 }
 
-Job *popJob(bool blocking = true){
-	PTCHK0(pthread_mutex_lock(&mtxUnclaimed), "Failed to lock mtxUnclaimed during pop");
+/**
+ * Make an unblocked job available to workers
+ * */
+void pushReady(Job *job){
+	ASSERT(job->getState() == JS_UNCLAIMED);
 
-	while(unclaimed_jobs <= 0){
-		if(!blocking){
-			PTCHK0(pthread_mutex_unlock(&mtxUnclaimed), "Failed to unlock mtxUnclaimed during pop");
-			return nullptr;
+	if(workerIndex >= 0){
+		workerDeques[workerIndex].push(job);
+	}else{
+		bool ok = readyQueue.push(job);
+		ASSERT(ok && "Ready queue is full");
+		(void)ok;
+	}
+
+	readyJobs.fetch_add(1);
+	if(sleepingWorkers.load() > 0){
+		PTCHK0(pthread_mutex_lock(&mtxIdle), "Failed to lock mtxIdle in pushReady");
+		PTCHK0(pthread_cond_signal(&cndIdle), "pthread_cond_signal failed for cndIdle");
+		PTCHK0(pthread_mutex_unlock(&mtxIdle), "Failed to unlock mtxIdle in pushReady");
+	}
+}
+
+/**
+ * Claim a ready job without blocking. Own deque first, then the shared
+ * ready queue, then try to steal from the other workers.
+ * */
+Job *tryPopJob(){
+	Job *ret = nullptr;
+	int self = workerIndex;
+
+	if(self >= 0){
+		ret = workerDeques[self].pop();
+	}
+
+	if(ret == nullptr){
+		readyQueue.pop(ret);
+	}
+
+	if(ret == nullptr){
+		int count = numWorkers.load(std::memory_order_acquire);
+		for(int i = 1; i <= count && ret == nullptr; i++){
+			int victim = (self + i) % count;
+			if(victim < 0){
+				victim += count;
+			}
+			if(victim != self){
+				ret = workerDeques[victim].steal();
+			}
 		}
-		PTCHK0(pthread_cond_wait(&cndJobs, &mtxUnclaimed), "pthread_cond_wait failed for cndJobs");
 	}
-	unclaimed_jobs--;
 
-	ASSERT(unclaimed_jobs >= 0 && "unclaimed_jobs is negative");
+	if(ret != nullptr){
+		readyJobs.fetch_sub(1);
+		ASSERT(ret->getState() == JS_UNCLAIMED);
+		ret->setState(JS_CLAIMED);
+	}
+	return ret;
+}
 
-	PTCHK0(pthread_mutex_unlock(&mtxUnclaimed), "Failed to unlock mtxUnclaimed during pop");
-	PTCHK0(pthread_mutex_lock(&mtxJobs), "Failed to lock mtxJobs during pop");
+/**
+ * Blocks until a job is available, or returns nullptr when shutting down
+ * */
+Job *popJob(){
+	for(;;){
+		Job *job = tryPopJob();
+		if(job != nullptr){
+			return job;
+		}
 
-	//find unclaimed job
-	Job *ret = nullptr;
-	for(int i = 0; i < MAX_JOBS; i++){
-		int cur_idx = i;
-		if(jobs[cur_idx] == nullptr){
+		if(readyJobs.load() > 0){
+			//a job was published but we lost the race for it; look again
 			continue;
 		}
-		//if(jobs[cur_idx]->state == JS_UNCLAIMED && ret == nullptr){
-		if(jobs[cur_idx]->getState() == JS_UNCLAIMED && ret == nullptr){
-			ret = jobs[cur_idx];
-			break;
-		}
-	}
 
-	ASSERT(ret != nullptr && "Failed to find any unclaimed jobs!");
-	ret->setState(JS_CLAIMED);
+		MICROPROFILE_SCOPEI("WorkerThread", "idle", 0x666666);
+		PTCHK0(pthread_mutex_lock(&mtxIdle), "Failed to lock mtxIdle during pop");
+		sleepingWorkers.fetch_add(1);
+		while(readyJobs.load() <= 0 && !shuttingDown.load()){
+			PTCHK0(pthread_cond_wait(&cndIdle, &mtxIdle), "pthread_cond_wait failed for cndIdle");
+		}
+		sleepingWorkers.fetch_sub(1);
+		PTCHK0(pthread_mutex_unlock(&mtxIdle), "Failed to unlock mtxIdle during pop");
 
-	PTCHK0(pthread_mutex_unlock(&mtxJobs), "Failed to unlock mtxJobs during pop");
-	return ret;
+		if(shuttingDown.load()){
+			return nullptr;
+		}
+	}
 }
 
 void setJobFinished(Job *job){
 	MICROPROFILE_SCOPEI("WorkerThread", "setJobFinished", 0xff8800);
-	PTCHK0(pthread_mutex_lock(&jobs_sync[job->handle].mtx), "Failed to lock job's mutex in setJobFinished");
-	job->state = JS_FINISHED;
+	JobHandle handle = job->handle;
+	JobSync &sync = jobs_sync[handle];
 
-	//unblock any dependents
+	Job *unblocked[MAX_DEPENDENTS];
 	int unblock_count = 0;
-	for(int i = 0; i < MAX_DEPENDENTS; i++){
-		Job *dep = job->dependents[i];
-		ASSERT(dep != job && "Invalid job dependency on self");
-		if(dep != nullptr){
-			dep->setState(JS_UNCLAIMED);
-			unblock_count++;
+
+	//once the state is JS_FINISHED the job may be joined and destroyed at
+	//any moment, so grab the dependents first and don't touch it afterwards
+	sync.lockDeps();
+	unblock_count = job->numDependents;
+	for(int i = 0; i < unblock_count; i++){
+		unblocked[i] = job->dependents[i];
+		ASSERT(unblocked[i] != job && "Invalid job dependency on self");
+	}
+	job->numDependents = 0;
+	job->state.store(JS_FINISHED);
+	sync.unlockDeps();
+
+	for(int i = 0; i < unblock_count; i++){
+		if(unblocked[i]->pendingParents.fetch_sub(1) == 1){
+			unblocked[i]->setState(JS_UNCLAIMED);
+			pushReady(unblocked[i]);
 		}
 	}
 
-	//signal that this job has changed state
-	PTCHK0(pthread_cond_signal(&jobs_sync[job->handle].cnd), "failed to broadcast job's condition variable");
-	PTCHK0(pthread_mutex_unlock(&jobs_sync[job->handle].mtx), "failed to unlock job's mutex in setJobFinished");
-
-	//signal that there are new unclaimed jobs
-	if(unblock_count > 0){
-		PTCHK0(pthread_mutex_lock(&mtxUnclaimed), "Failed to lock mtxUnclaimed during dep unblock");
-		unclaimed_jobs += unblock_count;
-		PTCHK0(pthread_cond_broadcast(&cndJobs), "Fail to broadcast mtxUnclaimed");
-		PTCHK0(pthread_mutex_unlock(&mtxUnclaimed), "Failed to unlock mtxUnclaimed during dep unblock");
+	//only pay for the broadcast if somebody is actually blocked in join()
+	if(sync.waiters.load() > 0){
+		PTCHK0(pthread_mutex_lock(&sync.mtx), "Failed to lock job's mutex in setJobFinished");
+		PTCHK0(pthread_cond_broadcast(&sync.cnd), "failed to broadcast job's condition variable");
+		PTCHK0(pthread_mutex_unlock(&sync.mtx), "failed to unlock job's mutex in setJobFinished");
 	}
 }
 
-JobHandle _pushJob(Job *job, JobHandle parent){
-	MICROPROFILE_SCOPEI("WorkerThread", "_pushJob", 0x01cb0f);
-	
-	//Find free space in jobs array
-	PTCHK0(pthread_mutex_lock(&mtxJobs), "pushJob failed to lock mtxJobs");
-	int idx = -1;
+void executeJob(Job *job);
 
-	for(int i = 0; i < MAX_JOBS; i++){
-		if(jobs[i] == nullptr){
-			idx = i;
-			break;
-		}else if(jobs[i]->getState() == JS_JOINED){
-			destroy_job(i);
-			idx = i;
-			break;
-		}
+JobHandle _pushJob(Job *job, JobHandle parent){
+	if(parent >= 0){
+		return _pushJob(job, &parent, 1);
 	}
+	return _pushJob(job, nullptr, 0);
+}
 
-	if(idx == -1){
+JobHandle _pushJob(Job *job, const JobHandle *parents, int numParents){
+	MICROPROFILE_SCOPEI("WorkerThread", "_pushJob", 0x01cb0f);
+
+	JobHandle idx = -1;
+	if(!freeHandles.pop(idx)){
 		ASSERT(!"Ran out of space for jobs");
 		return -1;
 	}
 
-	MICROPROFILE_SCOPEI("WorkerThread", "init new job", 0xcb010f);
-	
-	ASSERT(parent != idx && "Invalid dependency with self in pushJob");
+	ASSERT(jobs[idx] == nullptr);
 
-	PTCHK0(pthread_mutex_lock(&jobs_sync[idx].mtx), "failed to lock pushed job mutex");
 	job->handle = idx;
-	job->parent = nullptr;
+	job->seed = (jobSeedBase.load() + jobsSubmitted.fetch_add(1)) * 2654435761u;
+	job->numDependents = 0;
+	for(int i = 0; i < MAX_DEPENDENTS; i++){
+		job->dependents[i] = nullptr;
+	}
 
-	bool is_blocked = false;
-	if(parent >= 0){
-		PTCHK0(pthread_mutex_lock(&jobs_sync[parent].mtx), "failed to lock pushed job's parent mutex");
+	//hold one reference ourselves so parents finishing while we're still
+	//registering can't release the job early
+	job->pendingParents.store(1);
+	job->setState(JS_BLOCKED);
+	jobs[idx] = job;
+
+	for(int p = 0; p < numParents; p++){
+		JobHandle parent = parents[p];
+		if(parent < 0 || parent == idx){
+			//the parent's handle was joined and handed back out to us
+			continue;
+		}
 
 		Job *pj = jobs[parent];
 		if(pj == nullptr){
-			//parent was already destroyed, meaning it completed at some point
-			job->state = JS_UNCLAIMED;
-		}else{
-			//parent exists, need to check if it completed
-			JobState pst = pj->state;
-			switch(pst){
-				case JS_DEAD:
-				case JS_FINISHED:
-				case JS_JOINED:
-					//parent completed, no need to block
-					job->state = JS_UNCLAIMED;
-					break;
-				
-				case JS_UNCLAIMED:
-				case JS_CLAIMED:
-				case JS_BLOCKED:
-					is_blocked = true;
-					//parent hasn't completed, block and add us as a dependent of parent
-					job->state = JS_BLOCKED;
-					job->parent = pj;
-					bool added = false;
-					for(int i = 0; i < MAX_DEPENDENTS; i++){
-						if(pj->dependents[i] == nullptr){
-							pj->dependents[i] = job;
-							added = true;
-							break;
-						}
-					}
-					ASSERT(added && "Parent job has no more free dependent slots");
-					break;
+			//parent was already joined, meaning it completed at some point
+			continue;
+		}
+
+		JobSync &psync = jobs_sync[parent];
+		psync.lockDeps();
+		JobState pst = pj->getState();
+		while(pst != JS_FINISHED && pst != JS_JOINED && pj->numDependents >= MAX_DEPENDENTS){
+			//no free dependent slot to wait in, help out until the parent is done
+			psync.unlockDeps();
+			Job *other = tryPopJob();
+			if(other != nullptr){
+				executeJob(other);
+			}else{
+				SDL_Delay(1);
+			}
+			psync.lockDeps();
+			if(jobs[parent] != pj){
+				pst = JS_JOINED;
+				break;
 			}
+			pst = pj->getState();
 		}
-		PTCHK0(pthread_mutex_unlock(&jobs_sync[parent].mtx), "failed to lock pushed job's parent mutex");
-	}else{
-		job->state = JS_UNCLAIMED;
+		if(pst != JS_FINISHED && pst != JS_JOINED){
+			//parent hasn't completed, add us as a dependent of parent
+			job->pendingParents.fetch_add(1);
+			pj->dependents[pj->numDependents++] = job;
+		}
+		psync.unlockDeps();
 	}
-	for(int i = 0; i < MAX_DEPENDENTS; i++){
-		job->dependents[i] = nullptr;
+
+	if(job->pendingParents.fetch_sub(1) == 1){
+		job->setState(JS_UNCLAIMED);
+		pushReady(job);
 	}
-	jobs[idx] = job;
-	PTCHK0(pthread_mutex_unlock(&jobs_sync[idx].mtx), "failed to unlock pushed job mutex");
-	PTCHK0(pthread_mutex_unlock(&mtxJobs), "Failed to unlock mtxJobs during push");
+	return idx;
+}
+
+void executeJob(Job *job){
+	ASSERT(job->getState() == JS_CLAIMED);
+
+	//jobs can run inside another job's join, so restore the outer stream
+	bool outerActive = jobRandomActive;
+	unsigned outerState = jobRandomState;
+	jobRandomActive = true;
+	jobRandomState = job->seed;
+	job->execute();
+	jobRandomActive = outerActive;
+	jobRandomState = outerState;
 
-	//if job isn't blocked, signal that there's an unclaimed job available
-	if(!is_blocked){
-		PTCHK0(pthread_mutex_lock(&mtxUnclaimed), "Failed to lock mtxUnclaimed in pushJob");
-		unclaimed_jobs++;
-		PTCHK0(pthread_cond_signal(&cndJobs), "pthread_cond_signal failed");
-		PTCHK0(pthread_mutex_unlock(&mtxUnclaimed), "Failed to unlock mtxUnclaimed in pushJob");
+	setJobFinished(job);
+}
+
+int hardwareThreads(){
+#if PLATFORM_VITA
+	return VITA_USER_CORES;
+#else
+	int count = SDL_GetCPUCount();
+	return count > 0 ? count : 1;
+#endif
+}
+
+int defaultWorkerCount(){
+	//the thread that joins runs jobs too, so it keeps one of the cores
+	int count = hardwareThreads() - 1;
+	if(count < 1){
+		count = 1;
 	}
-	return (JobHandle) idx;
+	if(count > MAX_WORKERS){
+		count = MAX_WORKERS;
+	}
+	return count;
+}
+
+bool pinCurrentThread(int core){
+	core %= hardwareThreads();
+#if PLATFORM_VITA
+	return sceKernelChangeThreadCpuAffinityMask(sceKernelGetThreadId(), SCE_KERNEL_CPU_MASK_USER_0 << core) >= 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)core;
+	return false;
+#endif
 }
 
+static bool pinWorkers = false;
+
 thread_local bool alive;
 void *run_worker(void *pCtxt){	
     MicroProfileOnThreadCreate("WorkerThread");
 
-	ASSERT(pCtxt == nullptr);
+	workerIndex = (int)(intptr_t)pCtxt;
+	if(pinWorkers && !pinCurrentThread(workerIndex + 1)){
+		LOG("Failed to pin worker thread %d", workerIndex);
+	}
 
 	//LOG("<worker thread spawned>");
 	alive = true;
 	while(alive){
 		MICROPROFILE_SCOPEI("WorkerThread", "loop", 0x01cb0f);
 		Job *job = popJob();
-		ASSERT(job && "Invalid job");
-		job->execute();
-		setJobFinished(job);
+		if(job == nullptr){
+			break;
+		}
+		executeJob(job);
 	}
 	return nullptr;
 }
 
 std::vector<pthread_t> worker_threads;
-void spawnWorkers(int count){
+void spawnWorkers(int count, bool pin){
 	ASSERT(worker_threads.size() == 0);
-	LOG("Spawning %d worker threads", count);
+	if(count <= 0){
+		count = defaultWorkerCount();
+	}
+	if(count > MAX_WORKERS){
+		count = MAX_WORKERS;
+	}
+	LOG("Spawning %d worker threads (%d hardware threads)%s", count, hardwareThreads(), pin ? ", pinned" : "");
+
+	//the calling thread keeps core 0, workers take the ones after it
+	pinWorkers = pin;
+	if(pin && !pinCurrentThread(0)){
+		LOG("Failed to pin the main thread");
+	}
+
+	shuttingDown.store(false);
+	for(int i = 0; i < count; i++){
+		workerDeques[i].init();
+	}
+	numWorkers.store(count, std::memory_order_release);
+
 	for(int i = 0; i < count; i++){
 		pthread_t tid;
-		pthread_create(&tid, NULL, &run_worker, NULL);
+		pthread_create(&tid, NULL, &run_worker, (void*)(intptr_t)i);
 		worker_threads.push_back(tid);
 	}
 }
 
+void seedJobs(unsigned seed){
+	jobSeedBase.store(seed);
+	jobsSubmitted.store(0);
+}
+
+int currentWorker(){
+	return workerIndex;
+}
+
+int workerCount(){
+	return numWorkers.load(std::memory_order_acquire);
+}
+
 void killWorkers(){
-	for(size_t i = 0; i < worker_threads.size(); i++){
-		submitJob(WRK_DIE);
-	}
+	shuttingDown.store(true);
+	PTCHK0(pthread_mutex_lock(&mtxIdle), "Failed to lock mtxIdle in killWorkers");
+	PTCHK0(pthread_cond_broadcast(&cndIdle), "Failed to broadcast cndIdle in killWorkers");
+	PTCHK0(pthread_mutex_unlock(&mtxIdle), "Failed to unlock mtxIdle in killWorkers");
+
 	for(size_t i = 0; i < worker_threads.size(); i++){
 		pthread_join(worker_threads[i], NULL);
 	}
 	worker_threads.clear();
+
+	//any jobs left in the workers' deques can still be claimed through join()
+	//until spawnWorkers is called again
 }
 
 bool init(){
-	if(pthread_cond_init(&cndJobs, NULL) != 0){
+	if(pthread_cond_init(&cndIdle, NULL) != 0){
 		return false;
 	}
 
-	if(pthread_mutex_init(&mtxJobs, NULL) != 0){
+	if(pthread_mutex_init(&mtxIdle, NULL) != 0){
 		return false;
 	}
 
-	if(pthread_mutex_init(&mtxUnclaimed, NULL) != 0){
-		return false;
-	}
+	freeHandles.init();
+	readyQueue.init();
 
 	for(int i = 0; i < MAX_JOBS; i++){
 		ASSERT(jobs[i] == nullptr);
 		jobs_sync[i].init();
+		freeHandles.push(i);
 	}
 	return true;
 }
 
 void join(JobHandle &handle, bool work){
+	Job *j = jobs[handle];
+	ASSERT(j != nullptr && "job is null!");
+
 	if(work){
 		MICROPROFILE_SCOPEI("WorkerThread", "join-work", 0x66ffaa);
-		//only spin for a limited time
-		for(int i = 0; i < 5; i++){
+		//help out until the job is done, or until there's nothing left to claim
+		for(;;){
 			MICROPROFILE_SCOPEI("WorkerThread", "spin", 0x66ffaa);
 			if(tryJoin(handle)){
-				ASSERT(jobs[handle]->getState() == JS_JOINED);
 				return;
-			}else{
-				//do some work
-				Job *job = popJob(false);
-				if(job != nullptr){
-					ASSERT(job->getState() == JS_CLAIMED);
-					job->execute();
-					setJobFinished(job);
-					ASSERT(job->getState() == JS_FINISHED);
-				}
 			}
+			Job *job = tryPopJob();
+			if(job == nullptr){
+				break;
+			}
+			executeJob(job);
 		}
 	}
-	//regular blocking join
-	Job *j = jobs[handle];
-	
-	if(j->getState() == JS_BLOCKED){
-		LOG_TOGGLE(true);
-		//if theory correct, then both job type and parent type will be WRK_UPDATE_SKELETON_NORMALS(5)
-		Job *pj = j->parent;
-		LOG("WARNING: called join on a blocked job(%d | type: %d). Recursing to join parent.", (int)j->handle, (int)j->type);
-		if(pj == nullptr){
-			LOG("\tparent is null!");
-		}else{
-			LOG("\tparent is not null! handle: %d, type: %d", (int)pj->handle, (int)pj->type);
-		}
-		LOG_TOGGLE(false);
-
-		ASSERT(pj != nullptr && "Parent job is nullptr");
-		ASSERT(false && "Called join on a blocked job!");
-		ASSERT(j->parent != nullptr && "Parent is null");
-		join(j->parent->handle, work);
-	}
 
-	pthread_mutex_lock(&jobs_sync[handle].mtx);
-	while(j->state != JS_FINISHED){
-		LOG_TOGGLE(true);
-		if(j->state != JS_CLAIMED){
-			//LOG("join(%d |type: %d). Waiting for state to change from %d to %d", handle, (int)j->type, (int)j->state, (int)JS_FINISHED);
-		}
-		LOG_TOGGLE(false);
-		pthread_cond_wait(&jobs_sync[handle].cnd, &jobs_sync[handle].mtx);
+	//regular blocking join. A blocked job just waits for its parent to run
+	JobSync &sync = jobs_sync[handle];
+	PTCHK0(pthread_mutex_lock(&sync.mtx), "Failed to lock job's mutex in join");
+	sync.waiters.fetch_add(1);
+	while(j->getState() != JS_FINISHED){
+		PTCHK0(pthread_cond_wait(&sync.cnd, &sync.mtx), "pthread_cond_wait failed in join");
 	}
-	j->state = JS_JOINED; //can be destroyed
-	pthread_mutex_unlock(&jobs_sync[handle].mtx);
+	sync.waiters.fetch_sub(1);
+	j->setState(JS_JOINED); //can be destroyed
+	PTCHK0(pthread_mutex_unlock(&sync.mtx), "Failed to unlock job's mutex in join");
 
-	ASSERT(jobs[handle]->getState() == JS_JOINED);	
+	destroy_job(handle);
 }
 
 bool tryJoin(JobHandle &handle){
 	Job *j = jobs[handle];
 	ASSERT(j != nullptr && "job is null!");
-	int res = pthread_mutex_trylock(&jobs_sync[handle].mtx);
-	if(res == EBUSY){
-		return false;
-	}else if(res != 0){
-		ASSERT(!"pthread_mutex_trylock failed");
+	if(j->getState() != JS_FINISHED){
 		return false;
-	}else{
-		bool finished = (j->state == JS_FINISHED);
-		if(finished){
-			j->state = JS_JOINED;
-		}
-		pthread_mutex_unlock(&jobs_sync[handle].mtx);
-		return finished;
 	}
+	j->setState(JS_JOINED);
+	destroy_job(handle);
+	return true;
 }
 ////////////////////////
 
@@ -467,14 +755,25 @@ JobHandle submitJob(Job *j){
 	return _pushJob(j, -1);
 }
 
-#define DO_SUBMIT_JOB(T, ...) \
-	if(parent >= 0) {\
-		ret = submitDependentJob<T>(parent, ## __VA_ARGS__);\
-		jobs[ret]->type = type;\
-	}else{\
-		ret = submitJob<T>(__VA_ARGS__);\
-		jobs[ret]->type = type;\
+//same as the submitJob templates, but tags the job with its WorkTask before
+//it becomes visible to the workers
+template<typename T, typename... Args>
+JobHandle submitTypedJob(JobHandle parent, WorkTask type, Args... args){
+	void *jm = job_alloc(sizeof(T));
+	ASSERT(jm != nullptr && "Failed to allocate job instance");
+	T *job = new(jm) T(args...);
+	job->type = type;
+	JobHandle ret = _pushJob(job, parent);
+	if(ret == -1){
+		job->~T();
+		job_free(jm);
+		ASSERT(!"Job queue is full");
 	}
+	return ret;
+}
+
+#define DO_SUBMIT_JOB(T, ...) \
+	ret = submitTypedJob<T>(parent, type, ## __VA_ARGS__);
 
 JobHandle vsubmitJob(JobHandle parent, WorkTask type, va_list args){
     JobHandle ret = 0;
@@ -2,8 +2,13 @@
 #define __WORKERTHREAD_H___
 #include "Utils/Log.h"
 
+#include <atomic>
+#include <new>
+#include <vector>
+
 namespace WorkerThread{
 	static const int MAX_DEPENDENTS = 16;
+	static const int MAX_WORKERS = 16;
 
 	enum WorkTask {
 		WRK_NONE,
@@ -47,11 +52,17 @@ namespace WorkerThread{
 		 * until the parent job is finished
 		 * */
 		Job *dependents[MAX_DEPENDENTS];
-		Job *parent; //only valid while state is JS_BLOCKED
+		int numDependents;
+
+		//parents that haven't finished yet, job is released when it hits 0
+		std::atomic<int> pendingParents;
 
-		JobState state;
-		void setState(JobState set, bool safe = true);
-		JobState getState(bool safe = true);
+		//seeds Random() while the job runs
+		unsigned seed;
+
+		std::atomic<JobState> state;
+		void setState(JobState set);
+		JobState getState();
 
 		Job() = default;
 		virtual ~Job() = default;
@@ -61,6 +72,7 @@ namespace WorkerThread{
 
 	//internal use only!
 	JobHandle _pushJob(Job *job, JobHandle parent);
+	JobHandle _pushJob(Job *job, const JobHandle *parents, int numParents);
 
 	JobHandle submitJob(WorkTask type, ...);
 	JobHandle submitDependentJob(JobHandle parent, WorkTask type, ...);
@@ -76,6 +88,7 @@ namespace WorkerThread{
 		job->type = WRK_USER;
 		JobHandle ret = _pushJob(job, -1);
 		if(ret == -1){
+			job->~T();
 			job_free(jm);
 			ASSERT(!"Job queue is full");
 		}
@@ -95,6 +108,27 @@ namespace WorkerThread{
 		job->type = WRK_USER;
 		JobHandle ret = _pushJob(job, parent);
 		if(ret == -1){
+			job->~T();
+			job_free(jm);
+			ASSERT(!"Job queue is full");
+		}
+		return ret;
+	}
+
+	/**
+	 * Submit a job that won't run until all of its parents complete
+	 * 
+	 * None of the parent jobs may have been joined before calling this
+	 * */
+	template<typename T, typename... Args>
+	JobHandle submitDependentJob(const std::vector<JobHandle> &parents, Args... args){
+		void *jm = job_alloc(sizeof(T));
+		ASSERT(jm != nullptr && "Failed to allocate job instance");
+		T *job = new(jm) T(args...);
+		job->type = WRK_USER;
+		JobHandle ret = _pushJob(job, parents.empty() ? nullptr : &parents[0], parents.size());
+		if(ret == -1){
+			job->~T();
 			job_free(jm);
 			ASSERT(!"Job queue is full");
 		}
@@ -121,9 +155,38 @@ namespace WorkerThread{
 	 * */
 	bool tryJoin(JobHandle &handle);
 
-	void spawnWorkers(int count);
+	/**
+	 * Starts `count` workers, or defaultWorkerCount() if count is 0 or less.
+	 *
+	 * If `pin` is true the calling thread is bound to the first core and
+	 * each worker to one of the following ones (wrapping around), where the
+	 * platform supports it
+	 * */
+	void spawnWorkers(int count, bool pin = false);
 	void killWorkers();
 
+	//cores available to the game
+	int hardwareThreads();
+
+	//one worker per core, minus the core of the thread that joins
+	int defaultWorkerCount();
+
+	//binds the calling thread to a core, returns false if that isn't supported
+	bool pinCurrentThread(int core);
+
+	/**
+	 * Index of the calling worker thread, from 0 to MAX_WORKERS - 1,
+	 * or -1 for any other thread (which can still run jobs inside join)
+	 * */
+	int currentWorker();
+	int workerCount();
+
+	/**
+	 * Restarts the sequence of job seeds. Jobs submitted in the same order
+	 * from one thread after this get the same Random() streams
+	 * */
+	void seedJobs(unsigned seed);
+
 	bool init();
 }
 
@@ -36,8 +36,11 @@ along with Lugaru.  If not, see <http://www.gnu.org/licenses/>.
 #include "Platform/Platform.hpp"
 #include "User/Settings.hpp"
 #include "Menu/Menu.hpp"
+#include "Utils/Input.hpp"
 #include "Version.hpp"
+#include <json/writer.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <thread>
@@ -85,6 +88,8 @@ extern bool did_just_load;
 extern float gravity;
 extern float multiplier;
 extern float realmultiplier;
+extern float tickalpha;
+extern XYZ viewer;
 extern int slomo;
 extern bool cellophane;
 extern float texdetail;
@@ -278,6 +283,10 @@ SDL_bool sdlEventProc(const SDL_Event& e)
 
 static Point gMidPoint;
 
+/* benchmark mode: no drawing, fixed frame time instead of the wall clock */
+static bool headless = false;
+static float fixedmultiplier = 0;
+
 bool SetUp()
 {
     MICROPROFILE_SCOPEI("main", "SetUp", 0xffff3456);
@@ -323,6 +332,20 @@ bool SetUp()
         SaveSettings();
     }
 
+    // sound and level loading submit jobs, so the pool comes up first
+    int workers = workerthreads;
+    if (commandLineOptions[WORKERS]) {
+        const char* arg = commandLineOptions[WORKERS].last()->arg;
+        workers = arg ? atoi(arg) : 0;
+    }
+    bool pin = pinthreads;
+    if (commandLineOptions[PINTHREADS]) {
+        pin = commandLineOptions[PINTHREADS].last()->type();
+    }
+    LOG_TOGGLE(true);
+    WorkerThread::spawnWorkers(workers, pin);
+    LOG_TOGGLE(false);
+
     /*
     if (SDL_GL_LoadLibrary(NULL) == -1) {
         fprintf(stderr, "SDL_GL_LoadLibrary() failed: %s\n", SDL_GetError());
@@ -367,10 +390,15 @@ bool SetUp()
     if (commandLineOptions[FULLSCREEN]) {
         fullscreen = commandLineOptions[FULLSCREEN].last()->type();
     }
+    if (headless) {
+        // loading still uploads textures, so keep a context but never show it
+        sdlflags = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
+        fullscreen = false;
+    }
     if (fullscreen) {
         sdlflags |= SDL_WINDOW_FULLSCREEN;
     }
-    if (!commandLineOptions[NOMOUSEGRAB].last()->type()) {
+    if (!headless && !commandLineOptions[NOMOUSEGRAB].last()->type()) {
         sdlflags |= SDL_WINDOW_INPUT_GRABBED;
     }
 
@@ -421,7 +449,7 @@ bool SetUp()
     */
 
     SDL_ShowCursor(0);
-    if (!commandLineOptions[NOMOUSEGRAB].last()->type()) {
+    if (!headless && !commandLineOptions[NOMOUSEGRAB].last()->type()) {
         SDL_SetRelativeMouseMode(SDL_TRUE);
     }
 
@@ -513,13 +541,27 @@ void DoFrameRate(int update)
     }
 }
 
+/* simulation ticks per second for each physics quality setting */
+static const float tickRates[] = { 30, 60, 120, 200 };
+/* ticks are dropped past this, the game slows down instead of falling further behind */
+#define MAX_TICKS_PER_FRAME 8
+
+/**
+ * The simulation advances in fixed real-time steps taken from an accumulator
+ * of frame time, so the number of ticks (and their cost) only depends on how
+ * much time passed. Game speed, difficulty and slomo scale the simulated time
+ * of each tick, not the tick count. Frames are drawn tickalpha of the way
+ * between the last two ticks, see Person::drawOffset.
+ * */
 void DoUpdate()
 {
-    static float sps = 200;
-    static int count;
+    static float accumulator = 0;
     static float oldmult;
 
     DoFrameRate(1);
+    if (fixedmultiplier > 0) {
+        multiplier = fixedmultiplier;
+    }
 
     float multmax = 0.2;
 
@@ -531,29 +573,25 @@ void DoUpdate()
         did_just_load = false;
         multiplier = 0.001f;
         oldmult = 0.001f;
+        accumulator = 0;
     }
 
     fps = 1 / multiplier;
 
-    count = multiplier * sps;
-    if (count < 1) {
-        count = 1;
-    }
-    
-    int max_count;
-    if(phys_quality == 0){
-        max_count = 1;
-    }else if(phys_quality == 1){
-        max_count = 2;
-    }else if(phys_quality == 2){
-        max_count = 4;
-    }else{
-        max_count = 8; 
-    }
+    int quality = phys_quality < 0 ? 0 : phys_quality > 3 ? 3 : phys_quality;
+    const float step = 1 / tickRates[quality];
 
-    if(count > max_count){
-        count = max_count;
+    accumulator += multiplier;
+    int count = accumulator / step;
+    if (count > MAX_TICKS_PER_FRAME) {
+        count = MAX_TICKS_PER_FRAME;
+        accumulator = count * step;
     }
+    accumulator -= count * step;
+    if (accumulator < 0) {
+        accumulator = 0;
+    }
+    tickalpha = accumulator / step;
 
     realmultiplier = multiplier;
     multiplier *= gamespeed;
@@ -571,8 +609,9 @@ void DoUpdate()
         multiplier *= slomospeed;
     }
 
+    // each tick simulates one step of real time, scaled like the frame
     oldmult = multiplier;
-    multiplier /= (float)count;
+    multiplier *= step / realmultiplier;
 
     DoMouse();
 
@@ -585,6 +624,11 @@ void DoUpdate()
     multiplier = oldmult;
 
     TickOnceAfter();
+
+    // uploads decoded effects and refills the music streams, in menus and
+    // loading screens as well
+    updateSoundLoading();
+    OPENAL_Update();
     /* - Debug code to test how many channels were active on average per frame
         static long frames = 0;
 
@@ -619,11 +663,14 @@ void DoUpdate()
             num_channels = 0;
         }
     */
-    if (stereomode == stereoNone) {
-        DrawGLScene(stereoCenter);
-    } else {
-        DrawGLScene(stereoLeft);
-        DrawGLScene(stereoRight);
+    // benchmark mode only measures the simulation
+    if (!headless) {
+        if (stereomode == stereoNone) {
+            DrawGLScene(stereoCenter);
+        } else {
+            DrawGLScene(stereoLeft);
+            DrawGLScene(stereoRight);
+        }
     }
 
     MicroProfileFlip();
@@ -769,12 +816,134 @@ const option::Descriptor usage[] =
       { SHOWRESOLUTIONS, 0, "", "showresolutions", option::Arg::None, " --showresolutions List the resolutions found by SDL at launch." },
       { DEVTOOLS, 0, "d", "devtools", option::Arg::None, " -d, --devtools    Enable dev tools: console, level editor and debug info." },
       { CMD, 0, "c", "command", option::Arg::Optional, " -c, --command    Run this command at game start. May be used to load a map." },
+      { BENCHMARK, 0, "", "benchmark", option::Arg::Optional, " --benchmark=<map> Load a map and run it headless at a fixed timestep, then write timings and exit." },
+      { BENCHMARKFRAMES, 0, "", "benchmark-frames", option::Arg::Optional, " --benchmark-frames=<n> Number of frames to run in benchmark mode (default 1000)." },
+      { BENCHMARKOUT, 0, "", "benchmark-out", option::Arg::Optional, " --benchmark-out=<file> Per-scope timings CSV for benchmark mode (profiling builds only), a .json frame summary is written next to it." },
+      { RECORDINPUT, 0, "", "record-input", option::Arg::Optional, " --record-input=<file> Record the controller input of this session." },
+      { REPLAYINPUT, 0, "", "replay-input", option::Arg::Optional, " --replay-input=<file> Play back recorded input instead of reading the controller." },
+      { WORKERS, 0, "", "workers", option::Arg::Optional, " --workers=<n>     Number of worker threads, 0 for one per core (default)." },
+      { PINTHREADS, 1, "", "pin-threads", option::Arg::None, " --pin-threads     Bind the main thread and each worker thread to their own core." },
+      { PINTHREADS, 0, "", "no-pin-threads", option::Arg::None, " --no-pin-threads  Let the system schedule threads on any core (default)." },
       { 0, 0, 0, 0, 0, 0 }
     };
 
 option::Option commandLineOptions[commandLineOptionsNumber];
 option::Option* commandLineOptionsBuffer;
 
+#define BENCHMARK_SEED 1
+#define BENCHMARK_TIMESTEP (1.f / 60.f)
+#define BENCHMARK_DEFAULT_FRAMES 1000
+#define BENCHMARK_DEFAULT_OUT "benchmark.csv"
+
+/**
+ * Plays the map given to --benchmark for a fixed number of frames at a fixed
+ * timestep without drawing, then writes a per-frame summary as JSON, and the
+ * microprofile scope timings as CSV when the build has profiling enabled.
+ * Returns the process exit code.
+ * */
+static int RunBenchmark()
+{
+    const char* map = commandLineOptions[BENCHMARK].last()->arg;
+    if (!map || !*map) {
+        std::cerr << "--benchmark needs a map name" << std::endl;
+        return 1;
+    }
+
+    int frames = BENCHMARK_DEFAULT_FRAMES;
+    if (const char* arg = commandLineOptions[BENCHMARKFRAMES].last()->arg) {
+        frames = atoi(arg);
+        if (frames <= 0) {
+            std::cerr << "Invalid --benchmark-frames: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::string out = BENCHMARK_DEFAULT_OUT;
+    if (const char* arg = commandLineOptions[BENCHMARKOUT].last()->arg) {
+        out = arg;
+    }
+
+    // jobs get their own Random() streams, so seeding both is enough for
+    // runs to repeat whatever the thread scheduling
+    srand(BENCHMARK_SEED);
+    WorkerThread::seedJobs(BENCHMARK_SEED);
+    Menu::startChallengeLevel(1);
+    if (!LoadLevel(map)) {
+        std::cerr << "Could not load benchmark level '" << map << "'" << std::endl;
+        return 1;
+    }
+
+    MicroProfileSetForceEnable(true);
+    MicroProfileSetEnableAllGroups(true);
+    MicroProfileSetAggregateFrames(frames);
+
+    fixedmultiplier = BENCHMARK_TIMESTEP;
+
+    const double ticksToMs = 1000.0 / SDL_GetPerformanceFrequency();
+    std::vector<float> frametimes;
+    frametimes.reserve(frames);
+    for (int i = 0; i < frames && !tryquit; i++) {
+        deltah = 0;
+        deltav = 0;
+        Input::beginFrame();
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        DoUpdate();
+        frametimes.push_back((SDL_GetPerformanceCounter() - start) * ticksToMs);
+    }
+
+#if MICROPROFILE_ENABLED
+    // the dump is written at the start of the next flip
+    MicroProfileDumpFile(out.c_str(), MicroProfileDumpTypeCsv, frames);
+    MicroProfileFlip();
+    const bool wroteScopes = true;
+#else
+    std::cerr << "Built without profiling (configure with --profiling), per-scope timings are not written" << std::endl;
+    const bool wroteScopes = false;
+#endif
+
+    if (frametimes.empty()) {
+        return 1;
+    }
+
+    double total = 0;
+    for (float t : frametimes) {
+        total += t;
+    }
+    std::vector<float> sorted = frametimes;
+    std::sort(sorted.begin(), sorted.end());
+
+    const std::string summary = out + ".json";
+    FILE* f = fopen(summary.c_str(), "w");
+    if (!f) {
+        std::cerr << "Failed to write " << summary << std::endl;
+        return 1;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "  \"map\": %s,\n", Json::valueToQuotedString(map).c_str());
+    fprintf(f, "  \"frames\": %u,\n", (unsigned)frametimes.size());
+    fprintf(f, "  \"timestep\": %f,\n", BENCHMARK_TIMESTEP);
+    fprintf(f, "  \"seed\": %d,\n", BENCHMARK_SEED);
+    fprintf(f, "  \"total_ms\": %.3f,\n", total);
+    fprintf(f, "  \"mean_ms\": %.3f,\n", total / frametimes.size());
+    fprintf(f, "  \"median_ms\": %.3f,\n", sorted[sorted.size() / 2]);
+    fprintf(f, "  \"p95_ms\": %.3f,\n", sorted[sorted.size() * 95 / 100]);
+    fprintf(f, "  \"max_ms\": %.3f", sorted.back());
+    if (wroteScopes) {
+        fprintf(f, ",\n  \"scopes\": %s", Json::valueToQuotedString(out.c_str()).c_str());
+    }
+    fprintf(f, "\n}\n");
+    fclose(f);
+
+    std::cout << "Benchmark: " << frametimes.size() << " frames, mean "
+              << total / frametimes.size() << " ms, written to " << summary;
+    if (wroteScopes) {
+        std::cout << " and " << out;
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
 int lugaru_main(int argc, char** argv)
 {
     #if PLATFORM_VITA
@@ -839,6 +1008,14 @@ int lugaru_main(int argc, char** argv)
     {
         newGame();
 
+        headless = commandLineOptions[BENCHMARK].count() > 0;
+
+        // workers are spawned in SetUp once the settings are loaded
+        LOG_TOGGLE(true);
+        bool res = WorkerThread::init();
+        ASSERT(res && "Failed to init WorkerThread system");
+        LOG_TOGGLE(false);
+
         if (!SetUp()) {
             delete[] commandLineOptionsBuffer;
             return 42;
@@ -853,6 +1030,27 @@ int lugaru_main(int argc, char** argv)
 
         srand(time(nullptr));
 
+        if (commandLineOptions[REPLAYINPUT]) {
+            if (!Input::startReplay(commandLineOptions[REPLAYINPUT].last()->arg)) {
+                deleteGame();
+                CleanUp();
+                return 1;
+            }
+        } else if (headless) {
+            Input::startReplay(nullptr);
+        } else if (commandLineOptions[RECORDINPUT]) {
+            Input::startRecording(commandLineOptions[RECORDINPUT].last()->arg);
+        }
+
+        if (headless) {
+            int ret = RunBenchmark();
+            Input::stopStreams();
+            deleteGame();
+            CleanUp();
+            MicroProfileShutdown();
+            return ret;
+        }
+
         if (commandLineOptions[CMD].count() > 0) {
             devtools = true;
             Menu::startChallengeLevel(1);
@@ -863,10 +1061,6 @@ int lugaru_main(int argc, char** argv)
             }
         }
 
-        LOG_TOGGLE(true);
-        bool res = WorkerThread::init();
-        ASSERT(res && "Failed to init WorkerThread system");
-        WorkerThread::spawnWorkers(2);
         /*
         auto j1 = WorkerThread::submitJob(WorkerThread::WRK_TEST, (int)2, (int)12, (int)17);
         auto j2 = WorkerThread::submitJob(WorkerThread::WRK_TEST, (int)69, (int)420, (int)101);
@@ -881,8 +1075,6 @@ int lugaru_main(int argc, char** argv)
         LOG("j1 is done!");
         //*/
 
-        LOG_TOGGLE(false);
-
         while (!gameDone && !tryquit) {
             if (IsFocused()) {
                 gameFocused = true;
@@ -903,6 +1095,7 @@ int lugaru_main(int argc, char** argv)
                 }
 
                 update_analog_sticks();
+                Input::beginFrame();
 
                 // game
                 DoUpdate();
@@ -910,6 +1103,7 @@ int lugaru_main(int argc, char** argv)
                 if (gameFocused) {
                     // allow game chance to pause
                     gameFocused = false;
+                    Input::beginFrame();
                     DoUpdate();
                 }
 
@@ -918,6 +1112,7 @@ int lugaru_main(int argc, char** argv)
             }
         }
 
+        Input::stopStreams();
         deleteGame();
     }
 
@@ -0,0 +1,63 @@
+"""
+	Converts .solid models into the cooked mesh format read by
+	Model::readCooked (see CookedModel.hexpat).
+
+	The cooked file keeps the original name, the game tells the two formats
+	apart by the magic bytes at the start of the file.
+
+	usage: cook_model.py <input.solid> <output>
+"""
+import struct, sys
+
+MAGIC = b'LMDL'
+VERSION = 1
+HEADER_SIZE = 32
+ALIGN = 16
+
+def align(n):
+	return (n + ALIGN - 1) & ~(ALIGN - 1)
+
+def read_solid(data):
+	vertex_num, triangle_num = struct.unpack_from('>HH', data, 0)
+	off = 4
+	vertices = struct.unpack_from('>%df' % (vertex_num * 3), data, off)
+	off += vertex_num * 12
+	triangles = []
+	for i in range(triangle_num):
+		v = struct.unpack_from('>6H', data, off)
+		uv = struct.unpack_from('>6f', data, off + 12)
+		off += 36
+		for idx in v[0::2]:
+			if idx >= vertex_num:
+				raise ValueError('triangle %d uses vertex %d of %d' % (i, idx, vertex_num))
+		triangles.append((v[0], v[2], v[4]) + uv)
+	return vertices, triangles
+
+def cook(data):
+	vertices, triangles = read_solid(data)
+	vertex_num = len(vertices) // 3
+	vertex_off = HEADER_SIZE
+	triangle_off = align(vertex_off + vertex_num * 12)
+
+	out = bytearray(triangle_off + len(triangles) * 32)
+	struct.pack_into('<4s7I', out, 0, MAGIC, VERSION, vertex_num, len(triangles), vertex_off, triangle_off, 0, 0)
+	struct.pack_into('<%df' % len(vertices), out, vertex_off, *vertices)
+	for i, t in enumerate(triangles):
+		struct.pack_into('<4H6f', out, triangle_off + i * 32, t[0], t[1], t[2], 0, *t[3:])
+	return bytes(out)
+
+def cook_file(src, dst):
+	with open(src, 'rb') as f:
+		data = f.read()
+	if data[:4] == MAGIC:
+		cooked = data
+	else:
+		cooked = cook(data)
+	with open(dst, 'wb') as f:
+		f.write(cooked)
+
+if __name__ == '__main__':
+	if len(sys.argv) != 3:
+		print(__doc__.strip())
+		sys.exit(1)
+	cook_file(sys.argv[1], sys.argv[2])